@@ -0,0 +1,70 @@
+// Copyright 2018 Katolikian Tihran
+
+// measures how per-object counters of objects taken one after
+// another from a FreeList are updated by several threads, with
+// and without cache line padding of segments
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../include/freelist.hpp"
+
+struct Counter
+{
+    std::atomic <uint64_t> hits;
+    uint64_t owner;
+};
+
+template <FreeListPadding Padding>
+double run(const size_t thread_count, const size_t iterations)
+{
+    FreeList <Counter, Padding> list(thread_count);
+    std::vector <Counter *> counters;
+
+    for (size_t i = 0; i < thread_count; ++i)
+        counters.push_back(list.constructOnFreePlace());
+
+    std::vector <std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads.emplace_back([counter = counters[i], iterations] {
+            for (size_t j = 0; j < iterations; ++j)
+                counter->hits.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    for (std::thread &thread : threads)
+        thread.join();
+
+    const std::chrono::duration <double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+    for (Counter * const counter : counters)
+        list.destructAndMarkAsFree(counter);
+
+    return elapsed.count();
+}
+
+int main()
+{
+    const size_t hardware_threads = std::thread::hardware_concurrency();
+    const size_t thread_count = hardware_threads < 2 ? 4 : hardware_threads;
+    const size_t iterations = 20000000;
+
+    std::cout << thread_count << " threads, " << iterations
+              << " increments each\n";
+
+    for (int round = 0; round < 3; ++round) {
+        std::cout << "none:      " << run <FreeListPadding::none>(
+                             thread_count, iterations) << " ms\n";
+        std::cout << "cacheLine: " << run <FreeListPadding::cacheLine>(
+                             thread_count, iterations) << " ms\n";
+    }
+
+    return 0;
+}
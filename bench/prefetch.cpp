@@ -0,0 +1,74 @@
+// Copyright 2018 Katolikian Tihran
+
+// measures an allocate-then-construct loop over segments which
+// are not in cache. Built with and without "FL_PREFETCH".
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../include/freelist.hpp"
+
+struct Particle
+{
+    Particle(const uint64_t seed)
+    {
+        for (uint64_t &word : words)
+            word = seed;
+    }
+
+    uint64_t words[8];
+};
+
+int main()
+{
+    const size_t list_size = 1 << 21;
+    const int rounds = 5;
+
+    FreeList <Particle> list(list_size);
+    std::vector <Particle *> places(list_size);
+    std::vector <char> flush(64 << 20);
+    std::mt19937_64 random(42);
+    double best = 0.0;
+
+#ifdef FL_PREFETCH
+    std::cout << "with FL_PREFETCH\n";
+#else
+    std::cout << "without FL_PREFETCH\n";
+#endif // FL_PREFETCH
+
+    list.getFreePlaces(places.data(), list_size);
+
+    for (int round = 0; round < rounds; ++round) {
+        // ----------------------
+        // free in random order, so the next segment
+        // is far from the previous one
+        std::shuffle(places.begin(), places.end(), random);
+        list.markAsFree(places.data(), list_size);
+
+        // ----------------------
+        // push the segments out of cache
+        for (size_t i = 0; i < flush.size(); i += 64)
+            flush[i] = static_cast <char>(flush[i] + 1);
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < list_size; ++i)
+            places[i] = list.constructOnFreePlace(i);
+
+        const std::chrono::duration <double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - start;
+
+        std::cout << "round " << round << ": " << elapsed.count() << " ms\n";
+
+        if (round == 0 || elapsed.count() < best)
+            best = elapsed.count();
+    }
+
+    std::cout << "best: " << best / list_size * 1000000 << " ns per object\n";
+
+    return 0;
+}
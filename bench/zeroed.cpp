@@ -0,0 +1,95 @@
+// Copyright 2018 Katolikian Tihran
+
+// compares "getFreePlace" followed by memset with "getZeroedPlace"
+// on a new FreeList, and with "getZeroedPlaces" on a recycled one.
+//
+// On a new list "getZeroedPlace" does not touch the calloc'd pages,
+// so their page faults move to the first write of the caller. The
+// recycled list writes all of its pages before each measurement,
+// so there both variants only zero memory.
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "../include/freelist.hpp"
+
+struct Record
+{
+    uint64_t words[8];
+};
+
+// --------------------------
+// fills every segment of "list" with garbage, faulting
+// its pages in, and gives them back
+void dirty(FreeList <Record> &list, std::vector <Record *> &places)
+{
+    list.getFreePlaces(places.data(), places.size());
+
+    for (Record * const place : places)
+        std::memset(place, 0xff, sizeof(Record));
+
+    list.releaseAll();
+}
+
+template <class Function>
+double measure(Function fn)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    fn();
+
+    const std::chrono::duration <double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+    return elapsed.count();
+}
+
+int main()
+{
+    const size_t list_size = 1 << 22;
+    std::vector <Record *> places(list_size);
+
+    for (int round = 0; round < 3; ++round) {
+        const double fresh_memset = measure([&] {
+            FreeList <Record> list(list_size);
+
+            for (size_t i = 0; i < list_size; ++i)
+                std::memset(list.getFreePlace(), 0, sizeof(Record));
+        });
+
+        const double fresh_zeroed = measure([&] {
+            FreeList <Record> list(list_size);
+
+            for (size_t i = 0; i < list_size; ++i)
+                list.getZeroedPlace();
+        });
+
+        FreeList <Record> list(list_size);
+
+        dirty(list, places);
+
+        const double bulk_memset = measure([&] {
+            list.getFreePlaces(places.data(), list_size);
+
+            for (Record * const place : places)
+                std::memset(place, 0, sizeof(Record));
+        });
+
+        list.releaseAll();
+        dirty(list, places);
+
+        const double bulk_zeroed = measure([&] {
+            list.getZeroedPlaces(places.data(), list_size);
+        });
+
+        std::cout << "new list:      getFreePlace + memset " << fresh_memset
+                  << " ms, getZeroedPlace " << fresh_zeroed << " ms\n"
+                  << "recycled list: getFreePlaces + memset " << bulk_memset
+                  << " ms, getZeroedPlaces " << bulk_zeroed << " ms\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,392 @@
+// Copyright 2018 Katolikian Tihran
+
+// AllocationProfiler finds the call sites which hold or churn
+// most of a pool. Every "sample_period"-th allocation of the
+// pool it is attached to (see "FreeList::setProfiler") records
+// a backtrace and a timestamp, which are kept until the segment
+// is freed. The report groups samples by call site and scales
+// them by the sample period.
+//
+// The pool only counts allocations with its lock taken; the
+// backtrace of a sampled allocation is recorded after the lock
+// is released, so only the sampled allocations are slower and
+// they do not block other threads. A profiler is attached to one
+// pool at a time. Backtraces need <execinfo.h>, without it all
+// samples belong to one unknown site.
+
+#ifndef ALLOCATION_PROFILER_HPP
+#define ALLOCATION_PROFILER_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define FL_HAS_EXECINFO
+#endif // __has_include(<execinfo.h>)
+#endif // __has_include
+
+class AllocationProfiler
+{
+public:
+    // --------------------------
+    // one sampled allocation which was not freed yet
+    struct Sample
+    {
+        // call site, shown by "printSite"
+        size_t site;
+        size_t bytes;
+        // nanoseconds of std::chrono::steady_clock
+        uint64_t timestamp;
+    };
+
+    // --------------------------
+    // estimated usage of one call site
+    struct SiteReport
+    {
+        size_t site;
+        std::vector <void *> frames;
+        size_t allocations;
+        size_t frees;
+        size_t live;
+        size_t live_bytes;
+    };
+
+    // --------------------------
+    // samples one of "init_sample_period" allocations and keeps
+    // up to "init_max_depth" frames of its backtrace
+    explicit AllocationProfiler(const size_t init_sample_period = 1000,
+                                const size_t init_max_depth = 32);
+
+    // --------------------------
+    // copy constructor is forbidden
+    AllocationProfiler(const AllocationProfiler &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for AllocationProfiler
+    AllocationProfiler &operator =(const AllocationProfiler &) = delete;
+
+    // ---------------------
+    // hooks called by the pool: "attach" and "detach" when the
+    // profiler is set and unset, the others when segment "index"
+    // changes
+    void attach(const size_t slot_count);
+
+    void detach();
+
+    // ---------------------
+    // counts "count" allocations. Called with the pool lock
+    // taken. Returns the position of the first one to sample
+    // ("count" or more if there is none); the next ones follow
+    // every sample period.
+    size_t countAllocations(const size_t count);
+
+    // ---------------------
+    // records the backtrace of an allocation chosen by
+    // "countAllocations". Called after the pool lock is released.
+    void recordSample(const size_t index, const size_t bytes);
+
+    void onFree(const size_t index);
+
+    void onReleaseAll();
+
+    // ---------------------
+    // copies the sample of segment "index" to "out". Returns
+    // false if the segment was not sampled.
+    bool findSample(const size_t index, Sample &out) const;
+
+    // ---------------------
+    // returns the samples of all segments, by index
+    std::unordered_map <size_t, Sample> getSamples() const;
+
+    // ---------------------
+    // returns the call sites sorted by estimated live bytes
+    std::vector <SiteReport> getReport() const;
+
+    // ---------------------
+    // writes the first "max_sites" entries of "getReport"
+    // with their symbolized backtraces
+    void report(std::ostream &out, const size_t max_sites = 10) const;
+
+    // ---------------------
+    // writes the backtrace of call site "site"
+    void printSite(std::ostream &out, const size_t site) const;
+
+    // ---------------------
+    // current time in the units of Sample::timestamp
+    static uint64_t now();
+
+    size_t getSamplePeriod() const;
+
+private:
+    struct Site
+    {
+        std::vector <void *> frames;
+        size_t allocations;
+        size_t frees;
+        size_t live;
+        size_t live_bytes;
+    };
+
+    const size_t sample_period;
+    const size_t max_depth;
+    // allocations since the last sample
+    size_t counter;
+    // true if a pool is attached
+    bool attached;
+    // non-zero for segments with an entry in "live". Bytes
+    // rather than bits, so that segments sampled after the
+    // pool lock is released do not share memory locations.
+    std::vector <unsigned char> sampled;
+
+    mutable std::mutex profiler_mutex;
+    std::unordered_map <size_t, Sample> live;
+    std::map <std::vector <void *>, size_t> site_ids;
+    std::vector <Site> sites;
+
+    static void printFrames(std::ostream &out,
+                            const std::vector <void *> &frames);
+};
+
+inline AllocationProfiler::AllocationProfiler(const size_t init_sample_period,
+                                              const size_t init_max_depth)
+: sample_period(init_sample_period == 0 ? 1 : init_sample_period),
+  max_depth(init_max_depth),
+  counter(0),
+  attached(false)
+{
+}
+
+inline void AllocationProfiler::attach(const size_t slot_count)
+{
+    std::lock_guard <std::mutex> lg(profiler_mutex);
+
+    // ----------------------
+    // indices of two pools would mix in "sampled"
+    // and "live"
+    assert(!attached);
+
+    attached = true;
+    counter = 0;
+    sampled.assign(slot_count, false);
+    live.clear();
+
+    for (Site &site : sites) {
+        site.live = 0;
+        site.live_bytes = 0;
+    }
+}
+
+inline void AllocationProfiler::detach()
+{
+    std::lock_guard <std::mutex> lg(profiler_mutex);
+
+    attached = false;
+}
+
+inline size_t AllocationProfiler::countAllocations(const size_t count)
+{
+    const size_t first = sample_period - 1 - counter;
+
+    counter = (counter + count) % sample_period;
+    return first;
+}
+
+inline void AllocationProfiler::recordSample(const size_t index,
+                                             const size_t bytes)
+{
+    std::vector <void *> frames(max_depth);
+
+#ifdef FL_HAS_EXECINFO
+    frames.resize(static_cast <size_t>(
+            backtrace(frames.data(), static_cast <int>(max_depth))));
+#else
+    frames.clear();
+#endif // FL_HAS_EXECINFO
+
+    const uint64_t timestamp = now();
+    std::lock_guard <std::mutex> lg(profiler_mutex);
+
+    const auto found = site_ids.emplace(std::move(frames), sites.size());
+
+    if (found.second)
+        sites.push_back({found.first->first, 0, 0, 0, 0});
+
+    Site &site = sites[found.first->second];
+
+    ++site.allocations;
+    ++site.live;
+    site.live_bytes += bytes;
+
+    live[index] = {found.first->second, bytes, timestamp};
+    sampled[index] = true;
+}
+
+inline void AllocationProfiler::onFree(const size_t index)
+{
+    if (!sampled[index])
+        return;
+
+    std::lock_guard <std::mutex> lg(profiler_mutex);
+
+    const auto found = live.find(index);
+    Site &site = sites[found->second.site];
+
+    ++site.frees;
+    --site.live;
+    site.live_bytes -= found->second.bytes;
+
+    live.erase(found);
+    sampled[index] = false;
+}
+
+inline void AllocationProfiler::onReleaseAll()
+{
+    std::lock_guard <std::mutex> lg(profiler_mutex);
+
+    for (const std::pair <const size_t, Sample> &entry : live) {
+        Site &site = sites[entry.second.site];
+
+        ++site.frees;
+        --site.live;
+        site.live_bytes -= entry.second.bytes;
+        sampled[entry.first] = false;
+    }
+
+    live.clear();
+}
+
+inline bool AllocationProfiler::findSample(const size_t index,
+                                           Sample &out) const
+{
+    std::lock_guard <std::mutex> lg(profiler_mutex);
+
+    const auto found = live.find(index);
+
+    if (found == live.end())
+        return false;
+
+    out = found->second;
+    return true;
+}
+
+inline std::unordered_map <size_t, AllocationProfiler::Sample>
+AllocationProfiler::getSamples() const
+{
+    std::lock_guard <std::mutex> lg(profiler_mutex);
+
+    return live;
+}
+
+inline std::vector <AllocationProfiler::SiteReport>
+AllocationProfiler::getReport() const
+{
+    std::vector <SiteReport> result;
+
+    {
+        std::lock_guard <std::mutex> lg(profiler_mutex);
+
+        result.reserve(sites.size());
+
+        for (size_t i = 0; i < sites.size(); ++i) {
+            const Site &site = sites[i];
+
+            result.push_back({i, site.frames,
+                              site.allocations * sample_period,
+                              site.frees * sample_period,
+                              site.live * sample_period,
+                              site.live_bytes * sample_period});
+        }
+    }
+
+    std::sort(result.begin(), result.end(),
+              [](const SiteReport &a, const SiteReport &b) {
+                  if (a.live_bytes != b.live_bytes)
+                      return a.live_bytes > b.live_bytes;
+                  return a.allocations > b.allocations;
+              });
+
+    return result;
+}
+
+inline void AllocationProfiler::report(std::ostream &out,
+                                       const size_t max_sites) const
+{
+    const std::vector <SiteReport> sites_report = getReport();
+    const size_t count = std::min(max_sites, sites_report.size());
+
+    out << "sample period " << sample_period << ", "
+        << sites_report.size() << " call sites\n";
+
+    for (size_t i = 0; i < count; ++i) {
+        const SiteReport &site = sites_report[i];
+
+        out << "#" << i << " live " << site.live_bytes << " bytes in "
+            << site.live << " objects, allocated " << site.allocations
+            << ", freed " << site.frees << "\n";
+
+        printFrames(out, site.frames);
+    }
+}
+
+inline void AllocationProfiler::printSite(std::ostream &out,
+                                          const size_t site) const
+{
+    std::vector <void *> frames;
+
+    {
+        std::lock_guard <std::mutex> lg(profiler_mutex);
+        frames = sites[site].frames;
+    }
+
+    printFrames(out, frames);
+}
+
+inline uint64_t AllocationProfiler::now()
+{
+    return static_cast <uint64_t>(
+            std::chrono::duration_cast <std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+inline size_t AllocationProfiler::getSamplePeriod() const
+{
+    return sample_period;
+}
+
+inline void AllocationProfiler::printFrames(std::ostream &out,
+                                            const std::vector <void *> &frames)
+{
+    if (frames.empty()) {
+        out << "    <unknown>\n";
+        return;
+    }
+
+#ifdef FL_HAS_EXECINFO
+    const std::unique_ptr <char *, void (*)(void *)> symbols(
+            backtrace_symbols(frames.data(), static_cast <int>(frames.size())),
+            std::free);
+
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (symbols)
+            out << "    " << symbols.get()[i] << "\n";
+        else
+            out << "    " << frames[i] << "\n";
+    }
+#else
+    for (void * const frame : frames)
+        out << "    " << frame << "\n";
+#endif // FL_HAS_EXECINFO
+}
+
+#endif // ALLOCATION_PROFILER_HPP
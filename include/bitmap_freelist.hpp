@@ -0,0 +1,726 @@
+// Copyright 2018 Katolikian Tihran
+
+// BitmapFreeList has the interface of FreeList, but keeps
+// track of free segments with one bit per segment instead of
+// a pointer per segment. A summary level (one bit per bitmap
+// word) lets allocation find a free segment with a couple of
+// "count trailing zeros" instructions. Metadata takes about
+// 1/64 of the FreeList one, and occupancy of every segment
+// can be queried cheaply.
+
+// define "FL_THREAD_SAFETY" to compile the thread safe
+// variant of this library
+
+#ifndef BITMAP_FREELIST_HPP
+#define BITMAP_FREELIST_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+#ifdef FL_THREAD_SAFETY
+#include <mutex>
+#endif // FL_THREAD_SAFETY
+
+template <class Type>
+class BitmapFreeList
+{
+public:
+    // --------------------------
+    // creates a BitmapFreeList which can handle
+    // "init_list_size" objects of type "Type"
+    explicit BitmapFreeList(const size_t init_list_size);
+
+    // --------------------------
+    // copy constructor is forbidden
+    BitmapFreeList(const BitmapFreeList &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for BitmapFreeList
+    BitmapFreeList &operator =(const BitmapFreeList &) = delete;
+
+    // --------------------------
+    // move constructor
+    BitmapFreeList(BitmapFreeList &&rv);
+
+    ~BitmapFreeList();
+
+    // ---------------------
+    // returns pointer to the free segment with the lowest
+    // address. Throws std::runtime_error if there is none.
+    Type *getFreePlace();
+
+    // ---------------------
+    // acts as the previous one, but also creates an object of
+    // type "Type" in place and passes "args" in its constructor
+    template <class ...Args>
+    Type *constructOnFreePlace(Args &&...args);
+
+    // ---------------------
+    // returns pointer to the free segment closest to "hint"
+    // within the page of "hint", so objects used together
+    // share cache lines and pages. Falls back to
+    // "getFreePlace" if the page is full.
+    Type *getFreePlaceNear(const Type * const hint);
+
+    // ---------------------
+    // acts as the previous one, but also creates an object of
+    // type "Type" in place and passes "args" in its constructor
+    template <class ...Args>
+    Type *constructNear(const Type * const hint, Args &&...args);
+
+    // ---------------------
+    // returns pointer to the first of "count" contiguous free
+    // segments, so objects used together can share cache lines
+    // and be prefetched as one block. Throws std::runtime_error
+    // if there is no such run.
+    Type *getFreeRun(const size_t count);
+
+    // ---------------------
+    // acts as the previous one, but also creates "count"
+    // objects of type "Type" and passes "args" in every
+    // constructor
+    template <class ...Args>
+    Type *constructRun(const size_t count, const Args &...args);
+
+    // ---------------------
+    // marks pointer as free. Do not manage memory,
+    // operates only pointer.
+    void markAsFree(Type * const ptr);
+
+    // ---------------------
+    // marks a run returned by "getFreeRun" as free
+    void markRunAsFree(Type * const first, const size_t count);
+
+    // ---------------------
+    // calls destructors for all objects of the run and
+    // then calls "markRunAsFree" function
+    void destructRunAndMarkAsFree(Type * const first, const size_t count);
+
+    // ---------------------
+    // calls destructor for the object and then calls
+    // "markAsFree" function
+    void destructAndMarkAsFree(Type * const ptr);
+
+    // ---------------------
+    // returns true if the segment with "index" was returned
+    // by "getFreePlace" and was not marked as free yet
+    bool isOccupied(const size_t index) const;
+
+    // ---------------------
+    // calls "fn(index, ptr)" for every occupied segment in
+    // order of addresses. The bitmap is copied under the
+    // lock and "fn" is called after it is released.
+    template <class Function>
+    void forEachOccupied(Function fn) const;
+
+    // ---------------------
+    // number of occupied segments
+    size_t getOccupiedCount() const;
+
+    // ---------------------
+    // converts between pointers to segments and their
+    // indices in data
+    Type *at(const size_t index) const;
+
+    size_t getIndex(const Type * const ptr) const;
+
+    // ---------------------
+    // return size in bytes allocated for
+    // data
+    size_t getPhysicalSize() const;
+
+    // ---------------------
+    // calculates the size will be allocated for data in
+    // list of "size" elements
+    static size_t calculatePhysicalSize(const size_t size);
+
+    // ---------------------
+    // calculates the size will be allocated for bitmaps in
+    // list of "size" elements
+    static size_t calculateMetadataSize(const size_t size);
+
+private:
+    static constexpr size_t word_bits = 64;
+    // size of the region "getFreePlaceNear" searches in
+    static constexpr size_t page_size = 4096;
+
+    // size of the BitmapFreeList (number of objects which
+    // can be stored here)
+    const size_t list_size;
+    // number of words in free_bits
+    const size_t word_count;
+    // number of free segments
+    size_t free_count;
+    // there are no free segments in summary words
+    // before this one
+    size_t summary_hint;
+    // data for segments
+    char *data;
+    // bit is set if the segment is free. Words of
+    // the summary level follow the bitmap words.
+    uint64_t *free_bits;
+    // bit is set if the corresponding word of free_bits
+    // has at least one free segment
+    uint64_t *summary_bits;
+
+#ifdef FL_THREAD_SAFETY
+    mutable std::mutex fl_mutex;
+#endif // FL_THREAD_SAFETY
+
+    // ---------------------
+    // marks all memory as free.
+    // Required only for initialization
+    void freeAll();
+
+    // ---------------------
+    // marks the free segment with "index" as occupied and
+    // returns pointer to it. Should be called with the
+    // lock taken.
+    Type *takeSegment(const size_t index);
+
+    // ---------------------
+    // marks "count" segments from "first" as free or
+    // occupied. Should be called with the lock taken.
+    void markRange(const size_t first, const size_t count, const bool free);
+
+    // ---------------------
+    // bits of the word with "word" index which belong to
+    // segments from "first" to "last" (inclusive)
+    static uint64_t rangeMask(const size_t word,
+                              const size_t first, const size_t last);
+
+    static size_t countTrailingZeros(const uint64_t word);
+
+    static size_t highestBit(const uint64_t word);
+
+    static size_t wordsFor(const size_t bits);
+
+    // ---------------------
+    // allocate and free memory for "size" segments
+    // aligned as "Type" requires
+    static char *allocateData(const size_t size);
+
+    static void freeData(char * const ptr);
+};
+
+template <class Type>
+BitmapFreeList <Type>::BitmapFreeList(const size_t init_list_size)
+: list_size(init_list_size),
+  word_count(wordsFor(list_size)),
+  data(allocateData(list_size))
+{
+    try {
+        free_bits = new uint64_t[word_count + wordsFor(word_count)];
+    }
+    catch (std::bad_alloc &) {
+        freeData(data);
+        throw;
+    }
+
+    summary_bits = free_bits + word_count;
+    freeAll();
+}
+
+template <class Type>
+BitmapFreeList <Type>::BitmapFreeList(BitmapFreeList &&rv)
+: list_size(rv.list_size),
+  word_count(rv.word_count),
+  free_count(rv.free_count),
+  summary_hint(rv.summary_hint),
+  data(rv.data),
+  free_bits(rv.free_bits),
+  summary_bits(rv.summary_bits)
+{
+    // ------------------------
+    // we dont want previous owner of resources to
+    // free it, because there is a new owner
+    rv.free_count = 0;
+    rv.data = nullptr;
+    rv.free_bits = nullptr;
+}
+
+template <class Type>
+BitmapFreeList <Type>::~BitmapFreeList()
+{
+    freeData(data);
+    delete [] free_bits;
+}
+
+template <class Type>
+Type *BitmapFreeList <Type>::getFreePlace()
+{
+#ifdef FL_THREAD_SAFETY
+    std::lock_guard <std::mutex> lg(fl_mutex);
+#endif // FL_THREAD_SAFETY
+
+    // ---------------------
+    // check is there is at least one free place
+    if (free_count == 0)
+        throw std::runtime_error("BitmapFreeList overflow\n");
+
+    while (summary_bits[summary_hint] == 0)
+        ++summary_hint;
+
+    const size_t word = summary_hint * word_bits +
+                        countTrailingZeros(summary_bits[summary_hint]);
+
+    return takeSegment(word * word_bits + countTrailingZeros(free_bits[word]));
+}
+
+template <class Type>
+    template <class ...Args>
+Type *BitmapFreeList <Type>::constructOnFreePlace(Args &&...args)
+{
+    return new (getFreePlace()) Type(std::forward<Args>(args)...);
+}
+
+template <class Type>
+Type *BitmapFreeList <Type>::getFreePlaceNear(const Type * const hint)
+{
+    {
+#ifdef FL_THREAD_SAFETY
+        std::lock_guard <std::mutex> lg(fl_mutex);
+#endif // FL_THREAD_SAFETY
+
+        const size_t index = getIndex(hint);
+
+        // ---------------------
+        // segments which start in the page of "hint", as in
+        // "FreeList::getFreePlaceNear"
+        const uintptr_t data_address = reinterpret_cast <uintptr_t>(data);
+        const uintptr_t page_begin =
+                reinterpret_cast <uintptr_t>(hint) / page_size * page_size;
+        const size_t first = page_begin <= data_address ? 0 :
+                             (page_begin - data_address + sizeof(Type) - 1) /
+                             sizeof(Type);
+        const size_t page_last =
+                (page_begin + page_size - 1 - data_address) / sizeof(Type);
+        const size_t last = page_last < list_size ? page_last : list_size - 1;
+        const size_t hint_word = index / word_bits;
+
+        size_t best = list_size;
+        size_t best_distance = list_size;
+
+        // ---------------------
+        // look at words of the page going away from the
+        // hint until no segment of the next words can be
+        // closer than the best one found
+        for (size_t distance = 0; ; ++distance) {
+            const bool has_lower = hint_word >= first / word_bits + distance;
+            const bool has_upper = hint_word + distance <= last / word_bits;
+
+            if (!has_lower && !has_upper)
+                break;
+            if (distance != 0 &&
+                (distance - 1) * word_bits + 1 >= best_distance)
+                break;
+
+            auto consider = [&](const size_t candidate) {
+                const size_t candidate_distance = candidate > index ?
+                                                  candidate - index :
+                                                  index - candidate;
+                if (candidate_distance < best_distance) {
+                    best = candidate;
+                    best_distance = candidate_distance;
+                }
+            };
+
+            if (has_lower) {
+                const size_t word = hint_word - distance;
+                uint64_t bits = free_bits[word] & rangeMask(word, first, last);
+
+                if (distance == 0) {
+                    const uint64_t above = bits &
+                            (~uint64_t(0) << index % word_bits);
+
+                    if (above != 0)
+                        consider(word * word_bits + countTrailingZeros(above));
+                    bits &= ~above;
+                }
+                if (bits != 0)
+                    consider(word * word_bits + highestBit(bits));
+            }
+            if (has_upper && distance != 0) {
+                const size_t word = hint_word + distance;
+                const uint64_t bits = free_bits[word] &
+                                      rangeMask(word, first, last);
+
+                if (bits != 0)
+                    consider(word * word_bits + countTrailingZeros(bits));
+            }
+        }
+
+        if (best != list_size)
+            return takeSegment(best);
+    }
+
+    return getFreePlace();
+}
+
+template <class Type>
+    template <class ...Args>
+Type *BitmapFreeList <Type>::constructNear(const Type * const hint,
+                                           Args &&...args)
+{
+    return new (getFreePlaceNear(hint)) Type(std::forward<Args>(args)...);
+}
+
+template <class Type>
+Type *BitmapFreeList <Type>::getFreeRun(const size_t count)
+{
+    assert(count != 0);
+
+#ifdef FL_THREAD_SAFETY
+    std::lock_guard <std::mutex> lg(fl_mutex);
+#endif // FL_THREAD_SAFETY
+
+    if (free_count >= count) {
+        size_t run_first = 0;
+        size_t run_length = 0;
+
+        for (size_t word = summary_hint * word_bits; word < word_count; ++word) {
+            const uint64_t bits = free_bits[word];
+
+            // ---------------------
+            // the whole word is free: the run goes on
+            if (bits == ~uint64_t(0)) {
+                if (run_length == 0)
+                    run_first = word * word_bits;
+                run_length += word_bits;
+            }
+            else {
+                size_t bit = 0;
+
+                while (bit < word_bits && run_length < count) {
+                    const uint64_t rest = bits >> bit;
+
+                    if (rest & 1) {
+                        if (run_length == 0)
+                            run_first = word * word_bits + bit;
+
+                        const size_t ones = countTrailingZeros(~rest);
+                        run_length += ones;
+                        bit += ones;
+                    }
+                    else {
+                        run_length = 0;
+                        if (rest == 0)
+                            break;
+                        bit += countTrailingZeros(rest);
+                    }
+                }
+            }
+
+            if (run_length >= count) {
+                markRange(run_first, count, false);
+                return reinterpret_cast <Type *>
+                        (&data[run_first * sizeof(Type)]);
+            }
+        }
+    }
+
+    throw std::runtime_error("BitmapFreeList has no free run\n");
+}
+
+template <class Type>
+    template <class ...Args>
+Type *BitmapFreeList <Type>::constructRun(const size_t count,
+                                          const Args &...args)
+{
+    Type * const first = getFreeRun(count);
+    size_t constructed = 0;
+
+    try {
+        for (; constructed < count; ++constructed)
+            new (first + constructed) Type(args...);
+    }
+    catch (...) {
+        while (constructed != 0)
+            first[--constructed].~Type();
+        markRunAsFree(first, count);
+        throw;
+    }
+
+    return first;
+}
+
+template <class Type>
+void BitmapFreeList <Type>::markRunAsFree(Type * const first,
+                                          const size_t count)
+{
+#ifdef FL_THREAD_SAFETY
+    std::lock_guard <std::mutex> lg(fl_mutex);
+#endif // FL_THREAD_SAFETY
+
+    const size_t index = getIndex(first);
+
+    assert(index + count <= list_size);
+
+    markRange(index, count, true);
+}
+
+template <class Type>
+void BitmapFreeList <Type>::destructRunAndMarkAsFree(Type * const first,
+                                                     const size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        first[i].~Type();
+
+    markRunAsFree(first, count);
+}
+
+template <class Type>
+void BitmapFreeList <Type>::markAsFree(Type * const ptr)
+{
+#ifdef FL_THREAD_SAFETY
+    std::lock_guard <std::mutex> lg(fl_mutex);
+#endif // FL_THREAD_SAFETY
+
+    const size_t index = getIndex(ptr);
+    const size_t word = index / word_bits;
+
+    // ----------------------
+    // check if the segment was requested before
+    assert(isOccupied(index));
+
+    free_bits[word] |= uint64_t(1) << index % word_bits;
+    summary_bits[word / word_bits] |= uint64_t(1) << word % word_bits;
+    ++free_count;
+
+    if (word / word_bits < summary_hint)
+        summary_hint = word / word_bits;
+}
+
+template <class Type>
+void BitmapFreeList <Type>::destructAndMarkAsFree(Type * const ptr)
+{
+    ptr->~Type();
+    markAsFree(ptr);
+}
+
+template <class Type>
+bool BitmapFreeList <Type>::isOccupied(const size_t index) const
+{
+    assert(index < list_size);
+
+    return (free_bits[index / word_bits] >> index % word_bits & 1) == 0;
+}
+
+template <class Type>
+    template <class Function>
+void BitmapFreeList <Type>::forEachOccupied(Function fn) const
+{
+    std::vector <uint64_t> bits;
+
+    {
+#ifdef FL_THREAD_SAFETY
+        std::lock_guard <std::mutex> lg(fl_mutex);
+#endif // FL_THREAD_SAFETY
+
+        bits.assign(free_bits, free_bits + word_count);
+    }
+
+    for (size_t word = 0; word < word_count; ++word) {
+        uint64_t occupied = ~bits[word];
+
+        // ----------------------
+        // bits after the end of data are never free
+        if (word == word_count - 1 && list_size % word_bits != 0)
+            occupied &= (uint64_t(1) << list_size % word_bits) - 1;
+
+        while (occupied != 0) {
+            const size_t index = word * word_bits +
+                                 countTrailingZeros(occupied);
+            occupied &= occupied - 1;
+            fn(index, reinterpret_cast <Type *>
+                    (&data[index * sizeof(Type)]));
+        }
+    }
+}
+
+template <class Type>
+size_t BitmapFreeList <Type>::getOccupiedCount() const
+{
+#ifdef FL_THREAD_SAFETY
+    std::lock_guard <std::mutex> lg(fl_mutex);
+#endif // FL_THREAD_SAFETY
+
+    return list_size - free_count;
+}
+
+template <class Type>
+Type *BitmapFreeList <Type>::at(const size_t index) const
+{
+    assert(index < list_size);
+
+    return reinterpret_cast <Type *>(&data[index * sizeof(Type)]);
+}
+
+template <class Type>
+size_t BitmapFreeList <Type>::getIndex(const Type * const ptr) const
+{
+    // ----------------------
+    // check if adress is correct
+    assert(reinterpret_cast <const char *>(ptr) >= data);
+    assert(reinterpret_cast <const char *>(ptr) <= data +
+           (list_size - 1) * sizeof(Type));
+
+    return (reinterpret_cast <const char *>(ptr) - data) / sizeof(Type);
+}
+
+template <class Type>
+size_t BitmapFreeList <Type>::getPhysicalSize() const
+{
+    return list_size * sizeof(Type);
+}
+
+template <class Type>
+size_t BitmapFreeList <Type>::calculatePhysicalSize(const size_t size)
+{
+    return size * sizeof(Type);
+}
+
+template <class Type>
+size_t BitmapFreeList <Type>::calculateMetadataSize(const size_t size)
+{
+    return (wordsFor(size) + wordsFor(wordsFor(size))) * sizeof(uint64_t);
+}
+
+template <class Type>
+void BitmapFreeList <Type>::freeAll()
+{
+    const size_t summary_count = wordsFor(word_count);
+
+    for (size_t word = 0; word < word_count; ++word)
+        free_bits[word] = ~uint64_t(0);
+    for (size_t word = 0; word < summary_count; ++word)
+        summary_bits[word] = 0;
+
+    // ----------------------
+    // clear bits after the end of data, so they are
+    // never returned
+    if (list_size % word_bits != 0)
+        free_bits[word_count - 1] = (uint64_t(1) << list_size % word_bits) - 1;
+
+    for (size_t word = 0; word < word_count; ++word)
+        summary_bits[word / word_bits] |= uint64_t(1) << word % word_bits;
+
+    free_count = list_size;
+    summary_hint = 0;
+}
+
+template <class Type>
+Type *BitmapFreeList <Type>::takeSegment(const size_t index)
+{
+    const size_t word = index / word_bits;
+
+    free_bits[word] &= ~(uint64_t(1) << index % word_bits);
+    if (free_bits[word] == 0)
+        summary_bits[word / word_bits] &= ~(uint64_t(1) << word % word_bits);
+    --free_count;
+
+    return reinterpret_cast <Type *>(&data[index * sizeof(Type)]);
+}
+
+template <class Type>
+void BitmapFreeList <Type>::markRange(const size_t first,
+                                      const size_t count,
+                                      const bool free)
+{
+    const size_t last = first + count - 1;
+
+    for (size_t word = first / word_bits; word <= last / word_bits; ++word) {
+        const uint64_t mask = rangeMask(word, first, last);
+        const uint64_t summary_bit = uint64_t(1) << word % word_bits;
+
+        if (free) {
+            // ----------------------
+            // check if the segments were requested before
+            assert((free_bits[word] & mask) == 0);
+
+            free_bits[word] |= mask;
+            summary_bits[word / word_bits] |= summary_bit;
+        }
+        else {
+            free_bits[word] &= ~mask;
+            if (free_bits[word] == 0)
+                summary_bits[word / word_bits] &= ~summary_bit;
+        }
+    }
+
+    if (free) {
+        free_count += count;
+        if (first / word_bits / word_bits < summary_hint)
+            summary_hint = first / word_bits / word_bits;
+    }
+    else {
+        free_count -= count;
+    }
+}
+
+template <class Type>
+uint64_t BitmapFreeList <Type>::rangeMask(const size_t word,
+                                          const size_t first,
+                                          const size_t last)
+{
+    const size_t word_first = word * word_bits;
+    const size_t low = first > word_first ? first - word_first : 0;
+    const size_t high = last < word_first + word_bits - 1 ?
+                        last - word_first : word_bits - 1;
+
+    return (~uint64_t(0) << low) &
+           (~uint64_t(0) >> (word_bits - 1 - high));
+}
+
+template <class Type>
+size_t BitmapFreeList <Type>::countTrailingZeros(const uint64_t word)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return index;
+#else
+    return __builtin_ctzll(word);
+#endif // _MSC_VER
+}
+
+template <class Type>
+size_t BitmapFreeList <Type>::highestBit(const uint64_t word)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, word);
+    return index;
+#else
+    return word_bits - 1 - __builtin_clzll(word);
+#endif // _MSC_VER
+}
+
+template <class Type>
+size_t BitmapFreeList <Type>::wordsFor(const size_t bits)
+{
+    return (bits + word_bits - 1) / word_bits;
+}
+
+template <class Type>
+char *BitmapFreeList <Type>::allocateData(const size_t size)
+{
+    return static_cast <char *>(::operator new[](
+            size * sizeof(Type), std::align_val_t(alignof(Type))));
+}
+
+template <class Type>
+void BitmapFreeList <Type>::freeData(char * const ptr)
+{
+    ::operator delete[](ptr, std::align_val_t(alignof(Type)));
+}
+
+#endif // BITMAP_FREELIST_HPP
@@ -0,0 +1,351 @@
+// Copyright 2018 Katolikian Tihran
+
+// ColoredFreeList gives every thread its own region ("color")
+// of one slab. Regions start on a boundary of "granularity"
+// bytes (a cache line or a page), so objects allocated by
+// different threads never share a line or page, while objects
+// of one thread stay densely packed. Each region is a FreeList
+// guarded by a lock of its own: the FreeList one if
+// "FL_THREAD_SAFETY" is defined, a lock kept here otherwise, so
+// every operation takes exactly one lock. When the region of a
+// thread is exhausted the others are tried.
+//
+// Every list assigns colors to threads in the order they first
+// allocate from it. If more threads than regions use the list,
+// colors are reused round robin, so thread "n" of the list
+// shares region "n % region_count" with the earlier ones.
+// The list remembers the colors in a table of fixed size; a
+// thread which finds it full gets a color from its own number.
+// Objects may be freed by any thread.
+
+#ifndef COLORED_FREELIST_HPP
+#define COLORED_FREELIST_HPP
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "freelist.hpp"
+
+template <class Type>
+class ColoredFreeList
+{
+public:
+    // --------------------------
+    // creates a ColoredFreeList which can handle
+    // "init_list_size" objects of type "Type" in
+    // "init_region_count" regions aligned to
+    // "init_granularity" bytes (a power of two)
+    ColoredFreeList(const size_t init_list_size,
+                    const size_t init_region_count,
+                    const size_t init_granularity = 64);
+
+    // --------------------------
+    // copy constructor is forbidden
+    ColoredFreeList(const ColoredFreeList &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for ColoredFreeList
+    ColoredFreeList &operator =(const ColoredFreeList &) = delete;
+
+    ~ColoredFreeList();
+
+    // ---------------------
+    // returns a free segment from the region of the calling
+    // thread, or from another region if it is exhausted.
+    // Throws std::runtime_error if all regions are exhausted.
+    Type *getFreePlace();
+
+    // ---------------------
+    // creates an object of type "Type" on a free place and
+    // passes "args" in its constructor
+    template <class ...Args>
+    Type *constructOnFreePlace(Args &&...args);
+
+    // ---------------------
+    // marks segment as free in the region it belongs to
+    void markAsFree(Type * const ptr);
+
+    // ---------------------
+    // calls destructor of the object and marks it as free
+    void destructAndMarkAsFree(Type * const ptr);
+
+    // ---------------------
+    // returns the region "ptr" belongs to
+    size_t getRegion(const Type * const ptr) const;
+
+    // ---------------------
+    // returns the region of the calling thread, assigning
+    // the next color to a thread new to this list
+    size_t getThreadColor() const;
+
+    size_t getRegionCount() const;
+
+    // ---------------------
+    // return size in bytes allocated for
+    // data
+    size_t getPhysicalSize() const;
+
+private:
+#ifndef FL_THREAD_SAFETY
+    // --------------------------
+    // a lock per region, on its own cache line. Regions
+    // lock themselves under "FL_THREAD_SAFETY".
+    struct alignas(64) RegionLock
+    {
+        std::mutex mutex;
+    };
+#endif // FL_THREAD_SAFETY
+
+    // bits of a color table entry holding the color, the
+    // others hold the thread number (0 marks an empty entry)
+    static constexpr size_t color_bits = 16;
+    // smallest number of entries in the color table
+    static constexpr size_t min_color_table_size = 64;
+
+    const size_t region_count;
+    const size_t granularity;
+    // number of segments in every region
+    const size_t region_size;
+    // distance between regions in bytes
+    const size_t region_stride;
+    char *data;
+    std::unique_ptr <Type *[]> free_segments;
+    std::vector <FreeList <Type>> regions;
+#ifndef FL_THREAD_SAFETY
+    std::unique_ptr <RegionLock[]> locks;
+#endif // FL_THREAD_SAFETY
+    // number of entries in color_table, a power of two
+    const size_t color_table_size;
+    // colors of threads, open addressing by thread number
+    const std::unique_ptr <std::atomic <uint64_t>[]> color_table;
+    // color of the next thread new to this list
+    mutable std::atomic <size_t> next_color;
+
+    // ---------------------
+    // number of segments in every region, checks
+    // "init_region_count" before dividing by it
+    static size_t regionSize(const size_t init_list_size,
+                             const size_t init_region_count);
+
+    // ---------------------
+    // number of color table entries for "init_region_count"
+    // regions, so that the table is at most half full while
+    // every region has its own thread
+    static size_t colorTableSize(const size_t init_region_count);
+
+    // ---------------------
+    // returns the number of the calling thread, unique
+    // in the process and never 0
+    static uint64_t threadNumber();
+};
+
+template <class Type>
+ColoredFreeList <Type>::ColoredFreeList(const size_t init_list_size,
+                                        const size_t init_region_count,
+                                        const size_t init_granularity)
+: region_count(init_region_count),
+  granularity(init_granularity),
+  region_size(regionSize(init_list_size, init_region_count)),
+  region_stride((region_size * sizeof(Type) + init_granularity - 1) /
+                init_granularity * init_granularity),
+  data(nullptr),
+  free_segments(new Type *[region_size * region_count]),
+#ifndef FL_THREAD_SAFETY
+  locks(new RegionLock[init_region_count]),
+#endif // FL_THREAD_SAFETY
+  color_table_size(colorTableSize(init_region_count)),
+  color_table(new std::atomic <uint64_t>[color_table_size]),
+  next_color(0)
+{
+    assert((granularity & (granularity - 1)) == 0);
+    assert(alignof(Type) <= granularity);
+    assert(region_count <= (size_t(1) << color_bits));
+
+    for (size_t i = 0; i < color_table_size; ++i)
+        color_table[i].store(0, std::memory_order_relaxed);
+
+    data = static_cast <char *>(::operator new[](
+            region_stride * region_count, std::align_val_t(granularity)));
+
+    try {
+        regions.reserve(region_count);
+
+        for (size_t region = 0; region < region_count; ++region) {
+            regions.emplace_back(
+                    reinterpret_cast <Type *>(data + region * region_stride),
+                    &free_segments[region * region_size],
+                    region_size);
+        }
+    }
+    catch (...) {
+        ::operator delete[](data, std::align_val_t(granularity));
+        throw;
+    }
+}
+
+template <class Type>
+ColoredFreeList <Type>::~ColoredFreeList()
+{
+    regions.clear();
+    ::operator delete[](data, std::align_val_t(granularity));
+}
+
+template <class Type>
+Type *ColoredFreeList <Type>::getFreePlace()
+{
+    const size_t color = getThreadColor();
+
+    for (size_t i = 0; i < region_count; ++i) {
+        const size_t region = (color + i) % region_count;
+#ifndef FL_THREAD_SAFETY
+        std::lock_guard <std::mutex> lg(locks[region].mutex);
+#endif // FL_THREAD_SAFETY
+
+        // ----------------------
+        // nullptr means exhausted, try the next region
+        if (Type * const place = regions[region].tryGetFreePlace())
+            return place;
+    }
+
+    throw std::runtime_error("ColoredFreeList stack overflow\n");
+}
+
+template <class Type>
+    template <class ...Args>
+Type *ColoredFreeList <Type>::constructOnFreePlace(Args &&...args)
+{
+    Type * const place = getFreePlace();
+
+    try {
+        return new (place) Type(std::forward<Args>(args)...);
+    }
+    catch (...) {
+        markAsFree(place);
+        throw;
+    }
+}
+
+template <class Type>
+void ColoredFreeList <Type>::markAsFree(Type * const ptr)
+{
+    const size_t region = getRegion(ptr);
+#ifndef FL_THREAD_SAFETY
+    std::lock_guard <std::mutex> lg(locks[region].mutex);
+#endif // FL_THREAD_SAFETY
+
+    regions[region].markAsFree(ptr);
+}
+
+template <class Type>
+void ColoredFreeList <Type>::destructAndMarkAsFree(Type * const ptr)
+{
+    const size_t region = getRegion(ptr);
+
+    // ----------------------
+    // the destructor runs outside of the lock
+    ptr->~Type();
+
+#ifndef FL_THREAD_SAFETY
+    std::lock_guard <std::mutex> lg(locks[region].mutex);
+#endif // FL_THREAD_SAFETY
+
+    regions[region].markAsFree(ptr);
+}
+
+template <class Type>
+size_t ColoredFreeList <Type>::getRegion(const Type * const ptr) const
+{
+    assert(reinterpret_cast <const char *>(ptr) >= data);
+    assert(reinterpret_cast <const char *>(ptr) <
+           data + region_stride * region_count);
+
+    return (reinterpret_cast <const char *>(ptr) - data) / region_stride;
+}
+
+template <class Type>
+size_t ColoredFreeList <Type>::getThreadColor() const
+{
+    const uint64_t thread = threadNumber();
+    const size_t mask = color_table_size - 1;
+
+    // ----------------------
+    // entries are only ever added, so a thread which meets an
+    // empty entry is not in the table yet
+    for (size_t i = 0; i < color_table_size; ++i) {
+        std::atomic <uint64_t> &entry =
+                color_table[(thread + i) & mask];
+        uint64_t value = entry.load(std::memory_order_acquire);
+
+        if (value == 0) {
+            const size_t color =
+                    next_color.fetch_add(1, std::memory_order_relaxed) %
+                    region_count;
+            const uint64_t own = (thread << color_bits) | color;
+
+            if (entry.compare_exchange_strong(value, own,
+                                              std::memory_order_acq_rel))
+                return color;
+
+            // ----------------------
+            // another thread took the entry first. The color is
+            // skipped, which only shifts the round robin.
+        }
+
+        if ((value >> color_bits) == thread)
+            return value & ((uint64_t(1) << color_bits) - 1);
+    }
+
+    // ----------------------
+    // the table is full
+    return thread % region_count;
+}
+
+template <class Type>
+size_t ColoredFreeList <Type>::getRegionCount() const
+{
+    return region_count;
+}
+
+template <class Type>
+size_t ColoredFreeList <Type>::getPhysicalSize() const
+{
+    return region_stride * region_count;
+}
+
+template <class Type>
+size_t ColoredFreeList <Type>::regionSize(const size_t init_list_size,
+                                          const size_t init_region_count)
+{
+    assert(init_region_count != 0);
+
+    return (init_list_size + init_region_count - 1) / init_region_count;
+}
+
+template <class Type>
+size_t ColoredFreeList <Type>::colorTableSize(const size_t init_region_count)
+{
+    size_t size = min_color_table_size;
+
+    while (size < 2 * init_region_count)
+        size <<= 1;
+    return size;
+}
+
+template <class Type>
+uint64_t ColoredFreeList <Type>::threadNumber()
+{
+    static std::atomic <uint64_t> next_number(1);
+    static thread_local const uint64_t number =
+            next_number.fetch_add(1, std::memory_order_relaxed);
+
+    return number;
+}
+
+#endif // COLORED_FREELIST_HPP
@@ -0,0 +1,172 @@
+// Copyright 2018 Katolikian Tihran
+
+// DeferredRelease moves destruction of pooled objects off the
+// hot path. "defer" only enqueues the index of the object in
+// a lock-free SlotQueue; destructors are run and segments are
+// returned to the FreeList in batches by "drain", called at a
+// safe point or by a background thread.
+//
+// "defer" may be called from any thread. If drain runs on
+// another thread than allocations, the FreeList should be
+// compiled with "FL_THREAD_SAFETY".
+
+#ifndef DEFERRED_RELEASE_HPP
+#define DEFERRED_RELEASE_HPP
+
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+#include "freelist.hpp"
+#include "slot_queue.hpp"
+
+template <class Type>
+class DeferredRelease
+{
+public:
+    // --------------------------
+    // creates a queue for up to "capacity" objects
+    // of "init_pool" waiting for destruction
+    DeferredRelease(FreeList <Type> &init_pool, const size_t capacity);
+
+    // --------------------------
+    // copy constructor is forbidden
+    DeferredRelease(const DeferredRelease &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for DeferredRelease
+    DeferredRelease &operator =(const DeferredRelease &) = delete;
+
+    // --------------------------
+    // stops the background thread and destroys all
+    // objects left in the queue
+    ~DeferredRelease();
+
+    // ---------------------
+    // queues "ptr" for destruction. If the queue is full
+    // the object is destroyed right away.
+    void defer(Type * const ptr);
+
+    // ---------------------
+    // destroys up to "max_count" queued objects and marks
+    // them as free. Returns the number of destroyed objects.
+    size_t drain(const size_t max_count = std::numeric_limits <size_t>::max());
+
+    // ---------------------
+    // starts a thread which calls "drain" every "interval"
+    void startBackground(const std::chrono::milliseconds interval);
+
+    // ---------------------
+    // stops the background thread, queued objects
+    // stay in the queue
+    void stopBackground();
+
+private:
+    // number of segments returned to the FreeList at once
+    static constexpr size_t batch_size = 64;
+
+    FreeList <Type> &pool;
+    SlotQueue <uint32_t> queue;
+
+    std::thread background;
+    std::mutex background_mutex;
+    std::condition_variable background_wakeup;
+    bool background_running;
+};
+
+template <class Type>
+DeferredRelease <Type>::DeferredRelease(FreeList <Type> &init_pool,
+                                        const size_t capacity)
+: pool(init_pool),
+  queue(capacity),
+  background_running(false)
+{
+}
+
+template <class Type>
+DeferredRelease <Type>::~DeferredRelease()
+{
+    stopBackground();
+    drain();
+}
+
+template <class Type>
+void DeferredRelease <Type>::defer(Type * const ptr)
+{
+    const size_t index = pool.getIndex(ptr);
+
+    assert(index <= std::numeric_limits <uint32_t>::max());
+
+    if (!queue.tryPush(static_cast <uint32_t>(index)))
+        pool.destructAndMarkAsFree(ptr);
+}
+
+template <class Type>
+size_t DeferredRelease <Type>::drain(const size_t max_count)
+{
+    Type *batch[batch_size];
+    size_t drained = 0;
+
+    while (drained < max_count) {
+        size_t count = 0;
+        uint32_t index;
+
+        while (count < batch_size && drained + count < max_count &&
+               queue.tryPop(index)) {
+            batch[count] = pool.at(index);
+            batch[count]->~Type();
+            ++count;
+        }
+
+        if (count == 0)
+            break;
+
+        pool.markAsFree(batch, count);
+        drained += count;
+    }
+
+    return drained;
+}
+
+template <class Type>
+void DeferredRelease <Type>::startBackground(
+        const std::chrono::milliseconds interval)
+{
+    stopBackground();
+
+    background_running = true;
+    background = std::thread([this, interval] {
+        std::unique_lock <std::mutex> lock(background_mutex);
+
+        while (background_running) {
+            lock.unlock();
+            drain();
+            lock.lock();
+
+            background_wakeup.wait_for(lock, interval,
+                                       [this] { return !background_running; });
+        }
+    });
+}
+
+template <class Type>
+void DeferredRelease <Type>::stopBackground()
+{
+    if (!background.joinable())
+        return;
+
+    {
+        std::lock_guard <std::mutex> lg(background_mutex);
+        background_running = false;
+    }
+
+    background_wakeup.notify_one();
+    background.join();
+}
+
+#endif // DEFERRED_RELEASE_HPP
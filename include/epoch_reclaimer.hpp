@@ -0,0 +1,297 @@
+// Copyright 2018 Katolikian Tihran
+
+// EpochReclaimer tells when a node of a lock-free structure
+// built on a FreeList can go back to the pool. Readers pin
+// the current epoch while they access the structure; a removed
+// node is retired to the per-thread list of the global epoch
+// at the time it was retired and is destroyed (with "markAsFree" for the whole
+// batch) only after the global epoch moved two steps further,
+// when no reader which could see the node is left.
+//
+// Nodes are released from several threads, so the FreeList
+// should be compiled with "FL_THREAD_SAFETY".
+
+#ifndef EPOCH_RECLAIMER_HPP
+#define EPOCH_RECLAIMER_HPP
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "freelist.hpp"
+
+template <class Type>
+class EpochReclaimer
+{
+public:
+    // --------------------------
+    // state of one thread. Obtained with "registerThread"
+    // and used only by that thread.
+    class Participant
+    {
+    public:
+        // ---------------------
+        // announces that the thread starts reading
+        // the structure
+        void enter();
+
+        // ---------------------
+        // announces that the thread does not hold pointers
+        // to nodes anymore
+        void exit();
+
+        // ---------------------
+        // queues an unlinked node for destruction. Should
+        // be called between "enter" and "exit".
+        void retire(Type * const ptr);
+
+        // ---------------------
+        // tries to advance the global epoch and releases
+        // the nodes which became safe
+        void collect();
+
+    private:
+        friend class EpochReclaimer;
+
+        static constexpr size_t bucket_count = 3;
+
+        // (epoch << 1) | 1 while the thread is inside,
+        // zero otherwise
+        alignas(64) std::atomic <uint64_t> state{0};
+        std::atomic <bool> in_use{false};
+        EpochReclaimer *reclaimer = nullptr;
+        // nodes retired in epoch "bucket_epochs[i]"
+        std::vector <Type *> buckets[bucket_count];
+        uint64_t bucket_epochs[bucket_count] = {};
+        size_t retired_since_collect = 0;
+
+        void releaseBucket(const size_t bucket);
+
+        void releaseSafeBuckets(const uint64_t epoch);
+    };
+
+    // --------------------------
+    // RAII helper calling "enter" and "exit"
+    class Guard
+    {
+    public:
+        explicit Guard(Participant &init_participant)
+        : participant(init_participant)
+        {
+            participant.enter();
+        }
+
+        Guard(const Guard &) = delete;
+        Guard &operator =(const Guard &) = delete;
+
+        ~Guard()
+        {
+            participant.exit();
+        }
+
+    private:
+        Participant &participant;
+    };
+
+    // --------------------------
+    // creates a reclaimer for nodes of "init_pool" used
+    // by up to "max_threads" threads at once. Every thread
+    // collects after "init_collect_threshold" retired nodes.
+    EpochReclaimer(FreeList <Type> &init_pool,
+                   const size_t max_threads,
+                   const size_t init_collect_threshold = 64);
+
+    // --------------------------
+    // copy constructor is forbidden
+    EpochReclaimer(const EpochReclaimer &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for EpochReclaimer
+    EpochReclaimer &operator =(const EpochReclaimer &) = delete;
+
+    // --------------------------
+    // releases all retired nodes. No thread should be
+    // inside at this point.
+    ~EpochReclaimer();
+
+    // ---------------------
+    // returns the state for the calling thread. Throws
+    // std::runtime_error if "max_threads" are registered.
+    Participant &registerThread();
+
+    // ---------------------
+    // gives the state back. Nodes it retired stay in
+    // its lists until they are safe.
+    void unregisterThread(Participant &participant);
+
+    uint64_t getEpoch() const;
+
+private:
+    FreeList <Type> &pool;
+    const size_t participant_count;
+    const size_t collect_threshold;
+    std::unique_ptr <Participant[]> participants;
+    alignas(64) std::atomic <uint64_t> global_epoch;
+
+    // ---------------------
+    // moves the global epoch forward if every thread
+    // inside has seen the current one
+    void tryAdvance();
+};
+
+template <class Type>
+EpochReclaimer <Type>::EpochReclaimer(FreeList <Type> &init_pool,
+                                      const size_t max_threads,
+                                      const size_t init_collect_threshold)
+: pool(init_pool),
+  participant_count(max_threads),
+  collect_threshold(init_collect_threshold),
+  participants(new Participant[max_threads]),
+  global_epoch(0)
+{
+    for (size_t i = 0; i < participant_count; ++i)
+        participants[i].reclaimer = this;
+}
+
+template <class Type>
+EpochReclaimer <Type>::~EpochReclaimer()
+{
+    for (size_t i = 0; i < participant_count; ++i) {
+        for (size_t bucket = 0; bucket < Participant::bucket_count; ++bucket)
+            participants[i].releaseBucket(bucket);
+    }
+}
+
+template <class Type>
+typename EpochReclaimer <Type>::Participant &
+EpochReclaimer <Type>::registerThread()
+{
+    for (size_t i = 0; i < participant_count; ++i) {
+        bool expected = false;
+
+        if (participants[i].in_use.compare_exchange_strong(
+                expected, true, std::memory_order_acquire))
+            return participants[i];
+    }
+
+    throw std::runtime_error("EpochReclaimer has no free participant\n");
+}
+
+template <class Type>
+void EpochReclaimer <Type>::unregisterThread(Participant &participant)
+{
+    participant.state.store(0, std::memory_order_release);
+    participant.in_use.store(false, std::memory_order_release);
+}
+
+template <class Type>
+uint64_t EpochReclaimer <Type>::getEpoch() const
+{
+    return global_epoch.load(std::memory_order_acquire);
+}
+
+template <class Type>
+void EpochReclaimer <Type>::tryAdvance()
+{
+    uint64_t epoch = global_epoch.load(std::memory_order_seq_cst);
+
+    for (size_t i = 0; i < participant_count; ++i) {
+        const uint64_t state =
+                participants[i].state.load(std::memory_order_seq_cst);
+
+        if ((state & 1) != 0 && state >> 1 != epoch)
+            return;
+    }
+
+    global_epoch.compare_exchange_strong(epoch, epoch + 1,
+                                         std::memory_order_seq_cst);
+}
+
+template <class Type>
+void EpochReclaimer <Type>::Participant::enter()
+{
+    assert((state.load(std::memory_order_relaxed) & 1) == 0);
+
+    const uint64_t epoch =
+            reclaimer->global_epoch.load(std::memory_order_seq_cst);
+
+    // ----------------------
+    // the announcement must be visible before any
+    // node is read
+    state.store(epoch << 1 | 1, std::memory_order_seq_cst);
+
+    releaseSafeBuckets(epoch);
+}
+
+template <class Type>
+void EpochReclaimer <Type>::Participant::exit()
+{
+    state.store(0, std::memory_order_release);
+}
+
+template <class Type>
+void EpochReclaimer <Type>::Participant::retire(Type * const ptr)
+{
+    assert((state.load(std::memory_order_relaxed) & 1) != 0);
+
+    // ----------------------
+    // the global epoch may be one step ahead of the pinned one
+    // already, and readers pinned at it may hold the node. Taken
+    // after the node was unlinked, it is not older than the epoch
+    // of any reader which could see the node.
+    const uint64_t epoch =
+            reclaimer->global_epoch.load(std::memory_order_seq_cst);
+    const size_t bucket = epoch % bucket_count;
+
+    // ----------------------
+    // epochs of retired nodes never decrease, so the bucket
+    // holds nodes of epoch - 3 or older. The global epoch is
+    // at least "epoch" now, so they are safe already.
+    if (bucket_epochs[bucket] != epoch) {
+        releaseBucket(bucket);
+        bucket_epochs[bucket] = epoch;
+    }
+
+    buckets[bucket].push_back(ptr);
+
+    if (++retired_since_collect >= reclaimer->collect_threshold)
+        collect();
+}
+
+template <class Type>
+void EpochReclaimer <Type>::Participant::collect()
+{
+    retired_since_collect = 0;
+    reclaimer->tryAdvance();
+    releaseSafeBuckets(reclaimer->global_epoch.load(std::memory_order_seq_cst));
+}
+
+template <class Type>
+void EpochReclaimer <Type>::Participant::releaseBucket(const size_t bucket)
+{
+    std::vector <Type *> &nodes = buckets[bucket];
+
+    if (nodes.empty())
+        return;
+
+    for (Type * const node : nodes)
+        node->~Type();
+
+    reclaimer->pool.markAsFree(nodes.data(), nodes.size());
+    nodes.clear();
+}
+
+template <class Type>
+void EpochReclaimer <Type>::Participant::releaseSafeBuckets(
+        const uint64_t epoch)
+{
+    for (size_t bucket = 0; bucket < bucket_count; ++bucket) {
+        if (bucket_epochs[bucket] + 2 <= epoch)
+            releaseBucket(bucket);
+    }
+}
+
+#endif // EPOCH_RECLAIMER_HPP
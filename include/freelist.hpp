@@ -6,21 +6,144 @@
 // define "FL_THREAD_SAFETY" to compile the thread safe
 // variant of this library
 
+// define "FL_USDT" to compile USDT probes (provider "freelist")
+// for bpftrace, perf or systemtap. They need <sys/sdt.h> and
+// cost a nop instruction while nobody is attached:
+//   create(list, capacity, footprint)      destroy(list)
+//   alloc(list, ptr, priority)             alloc_batch(list, places, count)
+//   free(list, ptr)                        free_batch(list, ptrs, count)
+//   exhausted(list, priority, free_count)
+// Every list address gets one "create" and one "destroy": a move
+// fires "destroy" for the source and "create" for the new list,
+// and the emptied source fires nothing when it is destroyed. The
+// footprint of a list on pre-allocated data is 0.
+
+// define "FL_PREFETCH" to prefetch (for write) the segment the
+// next allocation will return, so its cache miss overlaps with
+// the construction of the current object. Whether it pays off
+// depends on the CPU and on the constructors, measure it with
+// "make bench" first
+
+// define "FL_LEAK_TRACKING" to keep the allocation time of every
+// segment and to report segments not freed when a FreeList
+// is destroyed
+
 #ifndef FREELIST_HPP
 #define FREELIST_HPP
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <ostream>
 #include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "allocation_profiler.hpp"
+#include "memory_budget.hpp"
 
 #ifdef FL_THREAD_SAFETY
 #include <mutex>
 #endif // FL_THREAD_SAFETY
 
+#ifdef FL_LEAK_TRACKING
+#include <iostream>
+#endif // FL_LEAK_TRACKING
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FL_HAS_SSE2
+#endif // __SSE2__
+
+#if defined(FL_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define FL_PROBE1(name, a) DTRACE_PROBE1(freelist, name, a)
+#define FL_PROBE2(name, a, b) DTRACE_PROBE2(freelist, name, a, b)
+#define FL_PROBE3(name, a, b, c) DTRACE_PROBE3(freelist, name, a, b, c)
+#endif // __has_include(<sys/sdt.h>)
+#endif // FL_USDT
+
+#ifndef FL_PROBE1
+#define FL_PROBE1(name, a) ((void)0)
+#define FL_PROBE2(name, a, b) ((void)0)
+#define FL_PROBE3(name, a, b, c) ((void)0)
+#endif // FL_PROBE1
+
+#if defined(FL_PREFETCH) && (defined(__GNUC__) || defined(__clang__))
+#define FL_PREFETCH_WRITE(address) __builtin_prefetch((address), 1)
+#elif defined(FL_PREFETCH) && defined(_MSC_VER) && \
+      (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define FL_PREFETCH_WRITE(address) \
+        _mm_prefetch(reinterpret_cast <const char *>(address), _MM_HINT_T0)
+#else
+#define FL_PREFETCH_WRITE(address) ((void)0)
+#endif // FL_PREFETCH
+
 // FreeList can prevent fragmentation, improve
 // locality of reference, has a simple interface,
 // is type safe, thread safe and reusable
 
-template <class Type>
+// --------------------------
+// priority of an allocation. Segments reserved with
+// "FreeList::setReserve" are given only to critical callers.
+enum class FreeListPriority
+{
+    normal,
+    critical
+};
+
+// --------------------------
+// counters of one priority tier
+struct FreeListTierStats
+{
+    // number of segments handed out
+    size_t allocations;
+    // number of requests refused because of the
+    // reserve or because the list is full
+    size_t refusals;
+};
+
+// --------------------------
+// state of a FreeList reported by "FreeList::getStats"
+struct FreeListStats
+{
+    // number of objects which can be stored
+    size_t capacity;
+    // number of segments handed out now
+    size_t live;
+    // the biggest "live" seen
+    size_t peak;
+    // bytes allocated for data and free segments
+    size_t footprint;
+    // share of live segments outside the first "live"
+    // segments of data (the ones compaction would move),
+    // from 0 (live segments are packed at the start)
+    // to 1 (none of them are)
+    double fragmentation;
+    // number of times the lock was taken by another thread
+    // (always zero without "FL_THREAD_SAFETY")
+    size_t lock_waits;
+};
+
+// --------------------------
+// layout of segments. With "cacheLine" every segment starts
+// on its own cache line, so objects used by different threads
+// do not share lines (no false sharing) at the cost of memory.
+enum class FreeListPadding
+{
+    none,
+    cacheLine
+};
+
+template <class Type, FreeListPadding Padding = FreeListPadding::none>
 class FreeList
 {
 public:
@@ -29,6 +152,12 @@ public:
     // objects of type "Type"
     explicit FreeList(const size_t init_list_size);
 
+    // --------------------------
+    // acts as the previous one, but charges "init_budget" for
+    // the allocated memory first and credits it in the destructor.
+    // Throws MemoryBudgetExceeded if the budget is exhausted.
+    FreeList(const size_t init_list_size, MemoryBudget &init_budget);
+
     // --------------------------
     // constructor for pre-allocated data
     FreeList(Type * const init_data,
@@ -41,10 +170,11 @@ public:
 
     // --------------------------
     // assigment is forbidden for FreeList
-    operator =(const FreeList &) = delete;
+    FreeList &operator =(const FreeList &) = delete;
 
     // --------------------------
-    // move constructor
+    // move constructor. The moved-from list has no data
+    // and no free segments.
     FreeList(FreeList &&rv);
 
     ~FreeList();
@@ -55,22 +185,148 @@ public:
     // because otherwise there is a risk it will be overrided
     Type *getFreePlace();
 
+    // ---------------------
+    // acts as the previous one, but normal priority callers
+    // get std::runtime_error when only reserved segments
+    // are left
+    Type *getFreePlace(const FreeListPriority priority);
+
+    // ---------------------
+    // acts as "getFreePlace", but returns nullptr instead
+    // of throwing when no segment can be given
+    Type *tryGetFreePlace();
+
+    Type *tryGetFreePlace(const FreeListPriority priority);
+
     // ---------------------
     // acts as the previous one, but also created as object of type
     // "Type" in place and passes "args" in its constructor.
     template <class ...Args>
     Type *constructOnFreePlace(Args... args);
-    
+
+    template <class ...Args>
+    Type *constructOnFreePlace(const FreeListPriority priority,
+                               Args &&...args);
+
+    // ---------------------
+    // acts as "getFreePlace", but prefers a free segment in the
+    // same cache line as "hint", then in the same page. Only the
+    // few most recently freed segments and the first untouched one
+    // are inspected, so the call stays O(1).
+    Type *getFreePlaceNear(const Type * const hint);
+
+    // ---------------------
+    // acts as the previous one, but also creates an object of
+    // type "Type" in place and passes "args" in its constructor
+    template <class ...Args>
+    Type *constructNear(const Type * const hint, Args &&...args);
+
+    // ---------------------
+    // writes "count" pointers to free segments into "places".
+    // Takes either all of them or (on overflow) none.
+    void getFreePlaces(Type ** const places, const size_t count);
+
+    // ---------------------
+    // value-initializes objects on "count" places returned by
+    // "getFreePlaces". Trivially default-constructible types are
+    // zeroed with one memset per contiguous run of places.
+    static void constructBatch(Type * const * const places,
+                               const size_t count);
+
+    // ---------------------
+    // returns a free segment filled with zero bytes. Segments
+    // never handed out since the FreeList was created are
+    // zero already and are not written.
+    Type *getZeroedPlace();
+
+    // ---------------------
+    // acts as "getFreePlaces", but zeroes the segments as
+    // "getZeroedPlace" does. Long contiguous runs are zeroed
+    // with non-temporal stores, which do not evict the cache.
+    void getZeroedPlaces(Type ** const places, const size_t count);
+
+    // ---------------------
+    // creates a copy of "*src" on a free place. Trivially
+    // copyable types are copied with memcpy.
+    Type *clone(const Type * const src);
+
+    // ---------------------
+    // moves the object from "ptr" to a free place of
+    // "destination" and marks "ptr" as free. Trivially
+    // copyable types are relocated with memcpy. If the move
+    // constructor throws, "ptr" stays occupied and the place
+    // in "destination" is freed.
+    Type *relocateTo(FreeList &destination, Type * const ptr);
+
     // ---------------------
     // marks pointer as free. Do not manage memory,
     // operates only pointer.
     void markAsFree(Type * const ptr);
 
+    // ---------------------
+    // marks "count" pointers from "ptrs" as free
+    // taking the lock once
+    void markAsFree(Type * const * const ptrs, const size_t count);
+
     // ---------------------
     // calls destructor for the object and then calls
     // "markAsFree" function
     void destructAndMarkAsFree(Type * const ptr);
 
+    // ---------------------
+    // marks all memory as free in O(1). Only allowed for
+    // trivially destructible types, because destructors of
+    // the objects left are not called.
+    void releaseAll();
+
+    // ---------------------
+    // calls "fn(index, ptr)" for every segment handed out, in
+    // order of addresses. Takes O(size) time and memory, but
+    // the lock is held only to copy the free segments stack:
+    // "fn" sees a snapshot, which other threads may change
+    // while it runs.
+    template <class Function>
+    void forEachOccupied(Function fn) const;
+
+    // ---------------------
+    // converts between pointers to segments and their
+    // indices in data
+    Type *at(const size_t index) const;
+
+    size_t getIndex(const Type * const ptr) const;
+
+    // ---------------------
+    // keeps "count" segments for critical callers. All other
+    // requests are normal priority.
+    void setReserve(const size_t count);
+
+    size_t getReserve() const;
+
+    // ---------------------
+    // returns counters of the "priority" tier
+    FreeListTierStats getTierStats(const FreeListPriority priority) const;
+
+    // ---------------------
+    // returns capacity, usage and contention counters.
+    // Fragmentation takes one pass over the recycled free
+    // segments with the lock taken.
+    FreeListStats getStats() const;
+
+    // ---------------------
+    // starts sampling allocations of this FreeList with
+    // "new_profiler" (nullptr stops). The profiler should be
+    // set before any segment is handed out and outlive
+    // this FreeList.
+    void setProfiler(AllocationProfiler * const new_profiler);
+
+    // ---------------------
+    // writes index and address of every segment not freed yet,
+    // with its age under "FL_LEAK_TRACKING" and its call site if
+    // the profiler sampled it. Returns the number of segments.
+    // The lock is held only to copy the state, not while the
+    // report is written.
+    size_t reportOutstanding(std::ostream &out) const;
+
     // ---------------------
     // return size in bytes allocated for
     // data
@@ -81,7 +337,42 @@ public:
     // list of "size" elements
     static size_t calculatePhysicalSize(const size_t size);
 
+    // ---------------------
+    // calculates the size will be allocated for data and
+    // free segments in list of "size" elements
+    static size_t calculateFootprint(const size_t size);
+
 private:
+    // sizes of the regions "getFreePlaceNear" tries
+    // to keep objects in
+    static constexpr size_t cache_line_size = 64;
+    static constexpr size_t page_size = 4096;
+    // number of free_segments entries (from the top)
+    // inspected by "getFreePlaceNear"
+    static constexpr size_t near_search_depth = 16;
+    // distance between segments and alignment of data
+    static constexpr size_t slot_size =
+            Padding == FreeListPadding::cacheLine ?
+            (sizeof(Type) + cache_line_size - 1) / cache_line_size *
+            cache_line_size : sizeof(Type);
+    // runs of zeroed segments longer than this (in bytes)
+    // are written with non-temporal stores
+    static constexpr size_t non_temporal_threshold = 256 * 1024;
+    static constexpr size_t slot_alignment =
+            Padding == FreeListPadding::cacheLine &&
+            alignof(Type) < cache_line_size ?
+            cache_line_size : alignof(Type);
+
+    // --------------------------
+    // allocations the profiler samples: the one at "first"
+    // and every sample period after it
+    struct Sampling
+    {
+        // nullptr if there was no profiler
+        AllocationProfiler *profiler;
+        size_t first;
+    };
+
     // this value depends on constructor called
     // to create this instance of FreeList
     bool free_resources_on_destr;
@@ -91,29 +382,140 @@ private:
     // required for iterating the free_segments array
     // (stack)
     size_t index_top;
+    // index of the first segment which was never returned
+    // by "getFreePlace". Segments from it to the end of data
+    // are free and are not stored in free_segments.
+    size_t untouched_index;
+    // index of the first segment which was never handed out
+    // (even before "releaseAll"). Segments from it to the end
+    // of data are known to be zero.
+    size_t clean_index;
+    // number of segments only critical callers can get
+    size_t reserved_count;
+    // counters of every priority tier
+    FreeListTierStats tier_stats[2];
+    // the biggest number of segments handed out at once
+    size_t peak_live;
+    // number of times "lockList" had to wait
+    mutable size_t lock_waits;
+    // profiler sampling allocations (nullptr if there is none)
+    AllocationProfiler *profiler;
+#ifdef FL_LEAK_TRACKING
+    // AllocationProfiler::now() of the last allocation
+    // of every segment
+    std::unique_ptr <uint64_t[]> allocation_times;
+#endif // FL_LEAK_TRACKING
+    // budget charged for the memory of this FreeList
+    // (nullptr if there is no budget)
+    MemoryBudget *budget;
     // data for segments
     char *data;
     // pointers to free segments (stack)
     char **free_segments;
 
 #ifdef FL_THREAD_SAFETY
-    std::mutex fl_mutex;
+    mutable std::mutex fl_mutex;
+
+    // ---------------------
+    // takes fl_mutex and counts the times it was
+    // held by another thread
+    std::unique_lock <std::mutex> lockList() const;
 #endif // FL_THREAD_SAFETY
 
     // ---------------------
-    // marks all memory as free.
-    // Required only for initialization
+    // marks all memory as free
     void freeAll();
+
+    // ---------------------
+    // number of free segments. Should be called with
+    // the lock taken
+    size_t freeCount() const;
+
+    // ---------------------
+    // copies the free segments stack into "stack" and returns
+    // untouched_index. Should be called with the lock taken
+    size_t copyFreeSegments(std::vector <char *> &stack) const;
+
+    // ---------------------
+    // calls "fn(index, ptr)" for every segment below "untouched"
+    // which is not in "stack", as copied by "copyFreeSegments"
+    template <class Function>
+    void visitOccupied(const std::vector <char *> &stack,
+                       const size_t untouched,
+                       Function fn) const;
+
+    // ---------------------
+    // throws std::runtime_error if "count" segments can not
+    // be given to a "priority" caller and updates the tier
+    // counters. Should be called with the lock taken
+    void reserveSegments(const FreeListPriority priority, const size_t count);
+
+    // ---------------------
+    // acts as "reserveSegments", but returns false
+    // instead of throwing
+    bool tryReserveSegments(const FreeListPriority priority,
+                            const size_t count);
+
+    // ---------------------
+    // returns a free segment. Should be called with
+    // the lock taken and at least one free segment
+    char *popFreeSegment();
+
+    // ---------------------
+    // returns the segment at untouched_index. Should be called
+    // with the lock taken and untouched segments left
+    char *takeUntouchedSegment();
+
+    // ---------------------
+    // zeroes the first "count" of "places" by contiguous runs
+    static void zeroPlaces(Type * const * const places, const size_t count);
+
+    // ---------------------
+    // memset or, for long ranges, non-temporal stores
+    static void zeroMemory(char *ptr, size_t bytes);
+
+    // ---------------------
+    // records the allocation of "count" places for the leak
+    // report and counts them for the profiler. Should be
+    // called with the lock taken
+    Sampling trackAllocations(Type * const * const places,
+                              const size_t count);
+
+    // ---------------------
+    // records backtraces of the places chosen by
+    // "trackAllocations". Should be called after the lock is
+    // released, so sampling does not block other threads
+    void sampleAllocations(Type * const * const places,
+                           const size_t count,
+                           const Sampling &sampling) const;
+
+    // ---------------------
+    // allocate (zeroed) and free memory for "size"
+    // segments aligned to slot_alignment
+    static char *allocateData(const size_t size);
+
+    static void freeData(char * const ptr);
 };
 
-template <class Type>
-FreeList <Type>::FreeList(const size_t init_list_size)
+template <class Type, FreeListPadding Padding>
+FreeList <Type, Padding>::FreeList(const size_t init_list_size)
 try : free_resources_on_destr(true),
       list_size(init_list_size),
-      data(new char[list_size * sizeof(Type)]),
+      clean_index(0),
+      reserved_count(0),
+      tier_stats(),
+      peak_live(0),
+      lock_waits(0),
+      profiler(nullptr),
+#ifdef FL_LEAK_TRACKING
+      allocation_times(new uint64_t[list_size]),
+#endif // FL_LEAK_TRACKING
+      budget(nullptr),
+      data(allocateData(list_size)),
       free_segments(new char *[list_size])
 {
     freeAll();
+    FL_PROBE3(create, this, list_size, calculateFootprint(list_size));
 }
 catch (std::bad_alloc &) {
     // ----------------------
@@ -121,23 +523,65 @@ catch (std::bad_alloc &) {
     throw;
 }
 
-template <class Type>
-FreeList <Type>::FreeList(Type * const init_data,
-                          Type ** const init_free_segments,
-                          const size_t init_list_size)
+template <class Type, FreeListPadding Padding>
+FreeList <Type, Padding>::FreeList(const size_t init_list_size,
+                                   MemoryBudget &init_budget)
+try : FreeList((init_budget.charge(calculateFootprint(init_list_size)),
+                init_list_size))
+{
+    budget = &init_budget;
+}
+catch (MemoryBudgetExceeded &) {
+    // ----------------------
+    // nothing was charged
+    throw;
+}
+catch (std::bad_alloc &) {
+    init_budget.credit(calculateFootprint(init_list_size));
+    throw;
+}
+
+template <class Type, FreeListPadding Padding>
+FreeList <Type, Padding>::FreeList(Type * const init_data,
+                                   Type ** const init_free_segments,
+                                   const size_t init_list_size)
 : free_resources_on_destr(false),
-  data(init_data),
-  free_segments(init_free_segments),
-  list_size(init_list_size)
+  list_size(init_list_size),
+  // ------------------------
+  // pre-allocated data may hold anything
+  clean_index(init_list_size),
+  reserved_count(0),
+  tier_stats(),
+  peak_live(0),
+  lock_waits(0),
+  profiler(nullptr),
+#ifdef FL_LEAK_TRACKING
+  allocation_times(new uint64_t[list_size]),
+#endif // FL_LEAK_TRACKING
+  budget(nullptr),
+  data(reinterpret_cast <char *>(init_data)),
+  free_segments(reinterpret_cast <char **>(init_free_segments))
 {
     freeAll();
+    FL_PROBE3(create, this, list_size, size_t(0));
 }
 
-template <class Type>
-FreeList <Type>::FreeList(FreeList &&rv)
+template <class Type, FreeListPadding Padding>
+FreeList <Type, Padding>::FreeList(FreeList &&rv)
 : free_resources_on_destr(rv.free_resources_on_destr),
   list_size(rv.list_size),
   index_top(rv.index_top),
+  untouched_index(rv.untouched_index),
+  clean_index(rv.clean_index),
+  reserved_count(rv.reserved_count),
+  tier_stats{rv.tier_stats[0], rv.tier_stats[1]},
+  peak_live(rv.peak_live),
+  lock_waits(rv.lock_waits),
+  profiler(rv.profiler),
+#ifdef FL_LEAK_TRACKING
+  allocation_times(std::move(rv.allocation_times)),
+#endif // FL_LEAK_TRACKING
+  budget(rv.budget),
   data(rv.data),
   free_segments(rv.free_segments)
 {
@@ -145,93 +589,938 @@ FreeList <Type>::FreeList(FreeList &&rv)
     // we dont want previous owner of resources to
     // free it, because there is a new owner
     rv.free_resources_on_destr = false;
+    rv.budget = nullptr;
+    rv.profiler = nullptr;
+    // ------------------------
+    // the previous owner must not hand out or visit segments
+    // of the new one, so it keeps no data and looks exhausted
+    rv.data = nullptr;
+    rv.free_segments = nullptr;
+    rv.index_top = 0;
+    rv.untouched_index = rv.list_size;
+    rv.clean_index = rv.list_size;
+
+    if (data) {
+        FL_PROBE1(destroy, &rv);
+        FL_PROBE3(create, this, list_size,
+                  free_resources_on_destr ? calculateFootprint(list_size) :
+                                            size_t(0));
+    }
 }
 
-template <class Type>
-FreeList <Type>::~FreeList()
+template <class Type, FreeListPadding Padding>
+FreeList <Type, Padding>::~FreeList()
 {
+#ifdef FL_LEAK_TRACKING
+    if (data && allocation_times && freeCount() != list_size)
+        reportOutstanding(std::cerr);
+#endif // FL_LEAK_TRACKING
+
     if (free_resources_on_destr) {
-        delete [] data;
+        freeData(data);
         delete [] free_segments;
     }
+
+    if (budget)
+        budget->credit(calculateFootprint(list_size));
+
+    if (profiler)
+        profiler->detach();
+
+    // ----------------------
+    // a moved-from list fired "destroy" when it was moved
+    if (data)
+        FL_PROBE1(destroy, this);
+}
+
+template <class Type, FreeListPadding Padding>
+Type *FreeList <Type, Padding>::getFreePlace()
+{
+    return getFreePlace(FreeListPriority::normal);
 }
 
-template <class Type>
-Type *FreeList <Type>::getFreePlace()
+template <class Type, FreeListPadding Padding>
+Type *FreeList <Type, Padding>::getFreePlace(const FreeListPriority priority)
 {
 #ifdef FL_THREAD_SAFETY
-    std::lock_guard <std::mutex> lg(fl_mutex);
+    std::unique_lock <std::mutex> lg = lockList();
 #endif // FL_THREAD_SAFETY
 
     // ---------------------
     // check is there is at least one free place
-    if (index_top == 0)
-        throw std::runtime_error("FreeList stack overflow\n");
+    // for this caller
+    reserveSegments(priority, 1);
 
     // --------------------
     // return pointer to the free segment
-    return reinterpret_cast <Type *>
-            (free_segments[--index_top]);
+    char * const place = popFreeSegment();
+    Type * const result = reinterpret_cast <Type *>(place);
+
+    FL_PROBE3(alloc, this, place, static_cast <int>(priority));
+
+    const Sampling sampling = trackAllocations(&result, 1);
+
+#ifdef FL_THREAD_SAFETY
+    lg.unlock();
+#endif // FL_THREAD_SAFETY
+
+    sampleAllocations(&result, 1, sampling);
+
+    return result;
 }
 
-template <class Type>
+template <class Type, FreeListPadding Padding>
+Type *FreeList <Type, Padding>::tryGetFreePlace()
+{
+    return tryGetFreePlace(FreeListPriority::normal);
+}
+
+template <class Type, FreeListPadding Padding>
+Type *FreeList <Type, Padding>::tryGetFreePlace(
+        const FreeListPriority priority)
+{
+#ifdef FL_THREAD_SAFETY
+    std::unique_lock <std::mutex> lg = lockList();
+#endif // FL_THREAD_SAFETY
+
+    if (!tryReserveSegments(priority, 1))
+        return nullptr;
+
+    char * const place = popFreeSegment();
+    Type * const result = reinterpret_cast <Type *>(place);
+
+    FL_PROBE3(alloc, this, place, static_cast <int>(priority));
+
+    const Sampling sampling = trackAllocations(&result, 1);
+
+#ifdef FL_THREAD_SAFETY
+    lg.unlock();
+#endif // FL_THREAD_SAFETY
+
+    sampleAllocations(&result, 1, sampling);
+
+    return result;
+}
+
+template <class Type, FreeListPadding Padding>
     template <class ...Args>
-Type *FreeList <Type>::constructOnFreePlace(Args... args)
+Type *FreeList <Type, Padding>::constructOnFreePlace(Args... args)
 {
     return new (getFreePlace()) Type(args...);
 }
 
-template <class Type>
-void FreeList <Type>::markAsFree(Type * const ptr)
+template <class Type, FreeListPadding Padding>
+    template <class ...Args>
+Type *FreeList <Type, Padding>::constructOnFreePlace(
+        const FreeListPriority priority,
+        Args &&...args)
+{
+    Type * const place = getFreePlace(priority);
+
+    try {
+        return new (place) Type(std::forward<Args>(args)...);
+    }
+    catch (...) {
+        markAsFree(place);
+        throw;
+    }
+}
+
+template <class Type, FreeListPadding Padding>
+Type *FreeList <Type, Padding>::getFreePlaceNear(const Type * const hint)
+{
+#ifdef FL_THREAD_SAFETY
+    std::unique_lock <std::mutex> lg = lockList();
+#endif // FL_THREAD_SAFETY
+
+    reserveSegments(FreeListPriority::normal, 1);
+
+    const uintptr_t hint_address = reinterpret_cast <uintptr_t>(hint);
+
+    // ---------------------
+    // 2 - same cache line, 1 - same page, 0 - far away
+    auto closeness = [hint_address](const char * const segment) {
+        const uintptr_t address = reinterpret_cast <uintptr_t>(segment);
+
+        if (address / cache_line_size == hint_address / cache_line_size)
+            return 2;
+        if (address / page_size == hint_address / page_size)
+            return 1;
+        return 0;
+    };
+
+    int best_closeness = 0;
+    size_t best_index = index_top;
+
+    if (untouched_index != list_size)
+        best_closeness = closeness(&data[untouched_index * slot_size]);
+
+    const size_t depth = index_top < near_search_depth ?
+                         index_top : near_search_depth;
+
+    for (size_t i = index_top;
+         i != index_top - depth && best_closeness < 2; --i) {
+        const int current = closeness(free_segments[i - 1]);
+
+        if (current > best_closeness) {
+            best_closeness = current;
+            best_index = i - 1;
+        }
+    }
+
+    char *place;
+
+    // ---------------------
+    // nothing is near, or the untouched segment is
+    // the best one: take it the usual way
+    if (best_index == index_top) {
+        if (best_closeness != 0)
+            place = takeUntouchedSegment();
+        else
+            place = popFreeSegment();
+    }
+    else {
+        // ---------------------
+        // move the chosen segment to the top of the stack
+        std::swap(free_segments[best_index], free_segments[index_top - 1]);
+        place = free_segments[--index_top];
+    }
+
+    Type * const result = reinterpret_cast <Type *>(place);
+
+    FL_PROBE3(alloc, this, place, static_cast <int>(FreeListPriority::normal));
+
+    const Sampling sampling = trackAllocations(&result, 1);
+
+#ifdef FL_THREAD_SAFETY
+    lg.unlock();
+#endif // FL_THREAD_SAFETY
+
+    sampleAllocations(&result, 1, sampling);
+
+    return result;
+}
+
+template <class Type, FreeListPadding Padding>
+    template <class ...Args>
+Type *FreeList <Type, Padding>::constructNear(const Type * const hint,
+                                              Args &&...args)
+{
+    return new (getFreePlaceNear(hint)) Type(std::forward<Args>(args)...);
+}
+
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::getFreePlaces(Type ** const places,
+                                             const size_t count)
+{
+#ifdef FL_THREAD_SAFETY
+    std::unique_lock <std::mutex> lg = lockList();
+#endif // FL_THREAD_SAFETY
+
+    reserveSegments(FreeListPriority::normal, count);
+
+    for (size_t i = 0; i < count; ++i)
+        places[i] = reinterpret_cast <Type *>(popFreeSegment());
+
+    FL_PROBE3(alloc_batch, this, places, count);
+
+    const Sampling sampling = trackAllocations(places, count);
+
+#ifdef FL_THREAD_SAFETY
+    lg.unlock();
+#endif // FL_THREAD_SAFETY
+
+    sampleAllocations(places, count, sampling);
+}
+
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::constructBatch(Type * const * const places,
+                                              const size_t count)
+{
+    if constexpr (std::is_trivially_default_constructible <Type>::value) {
+        // ----------------------
+        // places taken from the untouched part of data
+        // go one after another, so zero them by runs
+        size_t run_begin = 0;
+
+        for (size_t i = 1; i <= count; ++i) {
+            if (i == count || places[i] != places[i - 1] + 1) {
+                std::memset(static_cast <void *>(places[run_begin]), 0,
+                            (i - run_begin) * sizeof(Type));
+                run_begin = i;
+            }
+        }
+    }
+    else {
+        for (size_t i = 0; i < count; ++i)
+            new (places[i]) Type();
+    }
+}
+
+template <class Type, FreeListPadding Padding>
+Type *FreeList <Type, Padding>::getZeroedPlace()
+{
+    Type *result;
+    bool is_clean;
+    Sampling sampling;
+
+    {
+#ifdef FL_THREAD_SAFETY
+        std::unique_lock <std::mutex> lg = lockList();
+#endif // FL_THREAD_SAFETY
+
+        reserveSegments(FreeListPriority::normal, 1);
+
+        is_clean = index_top == 0 && untouched_index >= clean_index;
+
+        char * const place = popFreeSegment();
+
+        result = reinterpret_cast <Type *>(place);
+
+        FL_PROBE3(alloc, this, place,
+                  static_cast <int>(FreeListPriority::normal));
+        sampling = trackAllocations(&result, 1);
+    }
+
+    sampleAllocations(&result, 1, sampling);
+
+    // ----------------------
+    // zeroed without the lock
+    if (!is_clean)
+        std::memset(static_cast <void *>(result), 0, sizeof(Type));
+
+    return result;
+}
+
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::getZeroedPlaces(Type ** const places,
+                                               const size_t count)
+{
+    size_t dirty_count;
+    Sampling sampling;
+
+    {
+#ifdef FL_THREAD_SAFETY
+        std::unique_lock <std::mutex> lg = lockList();
+#endif // FL_THREAD_SAFETY
+
+        reserveSegments(FreeListPriority::normal, count);
+
+        // ----------------------
+        // places come from the stack first, then from the
+        // untouched part in order, so the clean ones are
+        // at the end
+        const size_t from_stack = index_top < count ? index_top : count;
+        const size_t from_untouched = count - from_stack;
+        const size_t dirty_untouched = clean_index > untouched_index ?
+                                       clean_index - untouched_index : 0;
+
+        dirty_count = from_stack + (dirty_untouched < from_untouched ?
+                                    dirty_untouched : from_untouched);
+
+        for (size_t i = 0; i < count; ++i)
+            places[i] = reinterpret_cast <Type *>(popFreeSegment());
+
+        FL_PROBE3(alloc_batch, this, places, count);
+
+        sampling = trackAllocations(places, count);
+    }
+
+    sampleAllocations(places, count, sampling);
+    zeroPlaces(places, dirty_count);
+}
+
+template <class Type, FreeListPadding Padding>
+Type *FreeList <Type, Padding>::clone(const Type * const src)
+{
+    if constexpr (std::is_trivially_copyable <Type>::value) {
+        Type * const place = getFreePlace();
+        std::memcpy(static_cast <void *>(place), src, sizeof(Type));
+        return place;
+    }
+    else {
+        Type * const place = getFreePlace();
+
+        try {
+            return new (place) Type(*src);
+        }
+        catch (...) {
+            markAsFree(place);
+            throw;
+        }
+    }
+}
+
+template <class Type, FreeListPadding Padding>
+Type *FreeList <Type, Padding>::relocateTo(FreeList &destination,
+                                           Type * const ptr)
+{
+    Type * const place = destination.getFreePlace();
+
+    if constexpr (std::is_trivially_copyable <Type>::value) {
+        std::memcpy(static_cast <void *>(place), ptr, sizeof(Type));
+    }
+    else {
+        try {
+            new (place) Type(std::move(*ptr));
+        }
+        catch (...) {
+            destination.markAsFree(place);
+            throw;
+        }
+        ptr->~Type();
+    }
+
+    markAsFree(ptr);
+    return place;
+}
+
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::markAsFree(Type * const ptr)
 {
 #ifdef FL_THREAD_SAFETY
-    std::lock_guard <std::mutex> lg(fl_mutex);
+    std::unique_lock <std::mutex> lg = lockList();
 #endif // FL_THREAD_SAFETY
 
     // ----------------------
     // check if adress is correct
     assert(reinterpret_cast <char *>(ptr) >= data);
     assert(reinterpret_cast <char *>(ptr) <= data +
-           (list_size - 1) * sizeof(Type));
+           (list_size - 1) * slot_size);
     // ----------------------
     // check if there was at least one request
     // for pointer before
-    assert(index_top < list_size);
+    assert(freeCount() < list_size);
 
     free_segments[index_top++] = reinterpret_cast <char *>
                                  (ptr);
+
+    if (profiler)
+        profiler->onFree(getIndex(ptr));
+
+    FL_PROBE2(free, this, ptr);
 }
 
-template <class Type>
-void FreeList <Type>::destructAndMarkAsFree(Type * const ptr)
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::markAsFree(Type * const * const ptrs,
+                                          const size_t count)
 {
 #ifdef FL_THREAD_SAFETY
-    std::lock_guard <std::mutex> lg(fl_mutex);
+    std::unique_lock <std::mutex> lg = lockList();
 #endif // FL_THREAD_SAFETY
 
+    assert(freeCount() + count <= list_size);
+
+    for (size_t i = 0; i < count; ++i) {
+        assert(reinterpret_cast <char *>(ptrs[i]) >= data);
+        assert(reinterpret_cast <char *>(ptrs[i]) <= data +
+               (list_size - 1) * slot_size);
+
+        free_segments[index_top++] = reinterpret_cast <char *>(ptrs[i]);
+
+        if (profiler)
+            profiler->onFree(getIndex(ptrs[i]));
+    }
+
+    FL_PROBE3(free_batch, this, ptrs, count);
+}
+
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::destructAndMarkAsFree(Type * const ptr)
+{
+    if constexpr (!std::is_trivially_destructible <Type>::value)
+        ptr->~Type();
+
     markAsFree(ptr);
-    ptr->~Type();
 }
 
-template <class Type>
-size_t FreeList <Type>::getPhysicalSize() const
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::releaseAll()
+{
+    static_assert(std::is_trivially_destructible <Type>::value,
+                  "releaseAll requires a trivially destructible Type");
+
+#ifdef FL_THREAD_SAFETY
+    std::unique_lock <std::mutex> lg = lockList();
+#endif // FL_THREAD_SAFETY
+
+    // ----------------------
+    // a moved-from list stays exhausted
+    if (data == nullptr)
+        return;
+
+    freeAll();
+
+    if (profiler)
+        profiler->onReleaseAll();
+}
+
+template <class Type, FreeListPadding Padding>
+    template <class Function>
+void FreeList <Type, Padding>::forEachOccupied(Function fn) const
 {
-    return list_size * sizeof(Type);
+    std::vector <char *> stack;
+    size_t untouched;
+
+    {
+#ifdef FL_THREAD_SAFETY
+        std::unique_lock <std::mutex> lg = lockList();
+#endif // FL_THREAD_SAFETY
+
+        untouched = copyFreeSegments(stack);
+    }
+
+    visitOccupied(stack, untouched, fn);
 }
 
-template <class Type>
-size_t FreeList <Type>::calculatePhysicalSize(const size_t size)
+template <class Type, FreeListPadding Padding>
+Type *FreeList <Type, Padding>::at(const size_t index) const
 {
-    return size * sizeof(Type);
+    assert(index < list_size);
+
+    return reinterpret_cast <Type *>(&data[index * slot_size]);
 }
 
-template <class Type>
-void FreeList <Type>::freeAll()
+template <class Type, FreeListPadding Padding>
+size_t FreeList <Type, Padding>::getIndex(const Type * const ptr) const
 {
-    size_t index = list_size - 1;
+    // ----------------------
+    // check if adress is correct
+    assert(reinterpret_cast <const char *>(ptr) >= data);
+    assert(reinterpret_cast <const char *>(ptr) <= data +
+           (list_size - 1) * slot_size);
+
+    return (reinterpret_cast <const char *>(ptr) - data) / slot_size;
+}
+
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::setReserve(const size_t count)
+{
+#ifdef FL_THREAD_SAFETY
+    std::unique_lock <std::mutex> lg = lockList();
+#endif // FL_THREAD_SAFETY
+
+    assert(count <= list_size);
+
+    reserved_count = count;
+}
+
+template <class Type, FreeListPadding Padding>
+size_t FreeList <Type, Padding>::getReserve() const
+{
+#ifdef FL_THREAD_SAFETY
+    std::unique_lock <std::mutex> lg = lockList();
+#endif // FL_THREAD_SAFETY
+
+    return reserved_count;
+}
+
+template <class Type, FreeListPadding Padding>
+FreeListTierStats FreeList <Type, Padding>::getTierStats(
+        const FreeListPriority priority) const
+{
+#ifdef FL_THREAD_SAFETY
+    std::unique_lock <std::mutex> lg = lockList();
+#endif // FL_THREAD_SAFETY
+
+    return tier_stats[static_cast <size_t>(priority)];
+}
+
+template <class Type, FreeListPadding Padding>
+FreeListStats FreeList <Type, Padding>::getStats() const
+{
+#ifdef FL_THREAD_SAFETY
+    std::unique_lock <std::mutex> lg = lockList();
+#endif // FL_THREAD_SAFETY
+
+    const size_t free_count = freeCount();
+    const size_t live = list_size - free_count;
+
+    // ----------------------
+    // every free segment below "live" stands for a live one
+    // beyond it. Untouched segments all lie at or past
+    // untouched_index, so only the stack is checked.
+    size_t misplaced = 0;
+
+    if (live != 0) {
+        const char * const packed_end = data + live * slot_size;
+
+        for (size_t i = 0; i < index_top; ++i)
+            misplaced += free_segments[i] < packed_end;
+    }
+
+    return {list_size,
+            live,
+            peak_live,
+            calculateFootprint(list_size),
+            live == 0 ? 0.0 : double(misplaced) / double(live),
+            lock_waits};
+}
+
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::setProfiler(
+        AllocationProfiler * const new_profiler)
+{
+#ifdef FL_THREAD_SAFETY
+    std::unique_lock <std::mutex> lg = lockList();
+#endif // FL_THREAD_SAFETY
+
+    if (profiler)
+        profiler->detach();
+
+    profiler = new_profiler;
+
+    if (profiler)
+        profiler->attach(list_size);
+}
+
+template <class Type, FreeListPadding Padding>
+size_t FreeList <Type, Padding>::reportOutstanding(std::ostream &out) const
+{
+    const uint64_t now = AllocationProfiler::now();
+    std::vector <char *> stack;
+    size_t untouched;
+    AllocationProfiler *sampler;
+    std::unordered_map <size_t, AllocationProfiler::Sample> samples;
+#ifdef FL_LEAK_TRACKING
+    std::vector <uint64_t> times;
+#endif // FL_LEAK_TRACKING
+
+    // ----------------------
+    // only copies are made with the lock taken, the report
+    // is formatted (and backtraces symbolized) after it is
+    // released
+    {
+#ifdef FL_THREAD_SAFETY
+        std::unique_lock <std::mutex> lg = lockList();
+#endif // FL_THREAD_SAFETY
+
+        untouched = copyFreeSegments(stack);
+        sampler = profiler;
+
+        if (sampler)
+            samples = sampler->getSamples();
+
+#ifdef FL_LEAK_TRACKING
+        if (untouched != 0) {
+            times.assign(allocation_times.get(),
+                         allocation_times.get() + untouched);
+        }
+#endif // FL_LEAK_TRACKING
+    }
+
+    size_t count = 0;
+
+    out << "FreeList " << static_cast <const void *>(this)
+        << " outstanding segments:\n";
+
+    visitOccupied(stack, untouched,
+                  [&](const size_t index, const Type * const ptr) {
+        const auto sample = samples.find(index);
+        const bool sampled = sample != samples.end();
+
+        out << "  #" << index << " " << static_cast <const void *>(ptr);
+
+#ifdef FL_LEAK_TRACKING
+        out << " age " << (now - times[index]) / 1000000 << " ms";
+#else
+        if (sampled) {
+            out << " age " << (now - sample->second.timestamp) / 1000000
+                << " ms";
+        }
+#endif // FL_LEAK_TRACKING
+
+        out << "\n";
+
+        if (sampled)
+            sampler->printSite(out, sample->second.site);
+
+        ++count;
+    });
+
+    out << count << " of " << list_size << " segments outstanding\n";
+
+    return count;
+}
+
+template <class Type, FreeListPadding Padding>
+size_t FreeList <Type, Padding>::getPhysicalSize() const
+{
+    return list_size * slot_size;
+}
+
+template <class Type, FreeListPadding Padding>
+size_t FreeList <Type, Padding>::calculatePhysicalSize(const size_t size)
+{
+    return size * slot_size;
+}
+
+template <class Type, FreeListPadding Padding>
+size_t FreeList <Type, Padding>::calculateFootprint(const size_t size)
+{
+    return calculatePhysicalSize(size) + size * sizeof(char *);
+}
+
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::freeAll()
+{
+    // ----------------------
+    // segments are handed out from the beginning of
+    // data, the stack is filled only by "markAsFree"
+    index_top = 0;
+    untouched_index = 0;
+}
+
+template <class Type, FreeListPadding Padding>
+size_t FreeList <Type, Padding>::freeCount() const
+{
+    return index_top + (list_size - untouched_index);
+}
+
+template <class Type, FreeListPadding Padding>
+size_t FreeList <Type, Padding>::copyFreeSegments(
+        std::vector <char *> &stack) const
+{
+    // ----------------------
+    // a moved-from list has nothing to visit
+    if (data == nullptr)
+        return 0;
+
+    stack.assign(free_segments, free_segments + index_top);
+    return untouched_index;
+}
+
+template <class Type, FreeListPadding Padding>
+    template <class Function>
+void FreeList <Type, Padding>::visitOccupied(const std::vector <char *> &stack,
+                                             const size_t untouched,
+                                             Function fn) const
+{
+    // ----------------------
+    // segments from "untouched" are free anyway,
+    // only the stack has to be marked
+    std::vector <bool> is_free(untouched, false);
+
+    for (char * const segment : stack)
+        is_free[(segment - data) / slot_size] = true;
+
+    for (size_t index = 0; index < untouched; ++index) {
+        if (!is_free[index])
+            fn(index, reinterpret_cast <Type *>(&data[index * slot_size]));
+    }
+}
+
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::reserveSegments(const FreeListPriority priority,
+                                               const size_t count)
+{
+    if (tryReserveSegments(priority, count))
+        return;
+
+    if (freeCount() < count)
+        throw std::runtime_error("FreeList stack overflow\n");
+    throw std::runtime_error("FreeList reserve reached\n");
+}
+
+template <class Type, FreeListPadding Padding>
+bool FreeList <Type, Padding>::tryReserveSegments(
+        const FreeListPriority priority,
+        const size_t count)
+{
+    FreeListTierStats &stats = tier_stats[static_cast <size_t>(priority)];
+    const size_t available = freeCount();
+
+    if (available < count ||
+        (priority == FreeListPriority::normal &&
+         available - count < reserved_count)) {
+        ++stats.refusals;
+        FL_PROBE3(exhausted, this, static_cast <int>(priority), available);
+        return false;
+    }
+
+    stats.allocations += count;
+
+    if (list_size - available + count > peak_live)
+        peak_live = list_size - available + count;
+
+    return true;
+}
+
+template <class Type, FreeListPadding Padding>
+char *FreeList <Type, Padding>::popFreeSegment()
+{
+    char *place;
+
+    if (index_top != 0)
+        place = free_segments[--index_top];
+    else
+        place = takeUntouchedSegment();
+
+#ifdef FL_PREFETCH
+    // ----------------------
+    // the segment the next call will return
+    if (index_top != 0)
+        FL_PREFETCH_WRITE(free_segments[index_top - 1]);
+    else if (untouched_index != list_size)
+        FL_PREFETCH_WRITE(&data[untouched_index * slot_size]);
+#endif // FL_PREFETCH
+
+    return place;
+}
+
+#ifdef FL_THREAD_SAFETY
+template <class Type, FreeListPadding Padding>
+std::unique_lock <std::mutex> FreeList <Type, Padding>::lockList() const
+{
+    std::unique_lock <std::mutex> lock(fl_mutex, std::try_to_lock);
+
+    if (!lock.owns_lock()) {
+        lock.lock();
+        ++lock_waits;
+    }
+
+    return lock;
+}
+#endif // FL_THREAD_SAFETY
+
+template <class Type, FreeListPadding Padding>
+char *FreeList <Type, Padding>::takeUntouchedSegment()
+{
+    char * const place = &(data[untouched_index++ * slot_size]);
+
+    if (clean_index < untouched_index)
+        clean_index = untouched_index;
+
+    return place;
+}
+
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::zeroPlaces(Type * const * const places,
+                                          const size_t count)
+{
+    size_t run_begin = 0;
+
+    for (size_t i = 1; i <= count; ++i) {
+        if (i == count ||
+            reinterpret_cast <char *>(places[i]) !=
+            reinterpret_cast <char *>(places[i - 1]) + slot_size) {
+            zeroMemory(reinterpret_cast <char *>(places[run_begin]),
+                       (i - run_begin - 1) * slot_size + sizeof(Type));
+            run_begin = i;
+        }
+    }
+}
+
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::zeroMemory(char *ptr, size_t bytes)
+{
+#ifdef FL_HAS_SSE2
+    if (bytes >= non_temporal_threshold) {
+        const size_t head = (16 - reinterpret_cast <uintptr_t>(ptr) % 16) % 16;
+        const __m128i zero = _mm_setzero_si128();
+
+        std::memset(ptr, 0, head);
+        ptr += head;
+        bytes -= head;
+
+        for (; bytes >= 64; bytes -= 64, ptr += 64) {
+            _mm_stream_si128(reinterpret_cast <__m128i *>(ptr), zero);
+            _mm_stream_si128(reinterpret_cast <__m128i *>(ptr + 16), zero);
+            _mm_stream_si128(reinterpret_cast <__m128i *>(ptr + 32), zero);
+            _mm_stream_si128(reinterpret_cast <__m128i *>(ptr + 48), zero);
+        }
+
+        // ----------------------
+        // non-temporal stores are weakly ordered, make them
+        // visible before the places are used
+        _mm_sfence();
+    }
+#endif // FL_HAS_SSE2
+
+    std::memset(ptr, 0, bytes);
+}
+
+template <class Type, FreeListPadding Padding>
+typename FreeList <Type, Padding>::Sampling
+FreeList <Type, Padding>::trackAllocations(Type * const * const places,
+                                           const size_t count)
+{
+#ifdef FL_LEAK_TRACKING
+    const uint64_t now = AllocationProfiler::now();
+
+    for (size_t i = 0; i < count; ++i)
+        allocation_times[getIndex(places[i])] = now;
+#endif // FL_LEAK_TRACKING
+
+    if (!profiler)
+        return {nullptr, count};
+
+    return {profiler, profiler->countAllocations(count)};
+}
+
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::sampleAllocations(
+        Type * const * const places,
+        const size_t count,
+        const Sampling &sampling) const
+{
+    if (!sampling.profiler)
+        return;
+
+    const size_t period = sampling.profiler->getSamplePeriod();
+
+    for (size_t i = sampling.first; i < count; i += period)
+        sampling.profiler->recordSample(getIndex(places[i]), slot_size);
+}
+
+template <class Type, FreeListPadding Padding>
+char *FreeList <Type, Padding>::allocateData(const size_t size)
+{
+    // ----------------------
+    // calloc takes fresh pages from the system zeroed, so
+    // untouched segments do not have to be zeroed again
+    if constexpr (slot_alignment <= alignof(std::max_align_t)) {
+        void * const ptr = std::calloc(size == 0 ? 1 : size, slot_size);
+
+        if (!ptr)
+            throw std::bad_alloc();
+
+        return static_cast <char *>(ptr);
+    }
+    else {
+        // ----------------------
+        // the pointer calloc returned is stored
+        // right before data
+        const size_t extra = slot_alignment + sizeof(void *);
+
+        if (size > (SIZE_MAX - extra) / slot_size)
+            throw std::bad_alloc();
+
+        char * const raw = static_cast <char *>(
+                std::calloc(size * slot_size + extra, 1));
+
+        if (!raw)
+            throw std::bad_alloc();
+
+        char * const ptr = raw + extra -
+                (reinterpret_cast <uintptr_t>(raw) + extra) % slot_alignment;
+
+        std::memcpy(ptr - sizeof(void *), &raw, sizeof(void *));
+        return ptr;
+    }
+}
+
+template <class Type, FreeListPadding Padding>
+void FreeList <Type, Padding>::freeData(char * const ptr)
+{
+    if constexpr (slot_alignment <= alignof(std::max_align_t)) {
+        std::free(ptr);
+    }
+    else {
+        char *raw;
 
-    for (index_top = 0; index_top < list_size; ++index_top) {
-        free_segments[index_top] = &(data[index-- * sizeof(Type)]);
+        std::memcpy(&raw, ptr - sizeof(void *), sizeof(void *));
+        std::free(raw);
     }
 }
 
@@ -0,0 +1,125 @@
+// Copyright 2018 Katolikian Tihran
+
+// FreeListPtr is a compressed pointer to an object living in a
+// pool (FreeList, BitmapFreeList or IndexFreeList). It stores
+// only the index of the segment, 32 bits by default, and is
+// resolved through the pool it was created from. Links between
+// pooled objects become two or more times smaller, so more of
+// them fit in a cache line, and stay valid if the pool's data
+// is mapped at another address.
+
+#ifndef FREELIST_PTR_HPP
+#define FREELIST_PTR_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+template <class Type, class Index = uint32_t>
+class FreeListPtr
+{
+    static_assert(std::is_unsigned <Index>::value,
+                  "Index must be an unsigned integer type");
+
+public:
+    using index_type = Index;
+
+    // --------------------------
+    // creates a null pointer
+    FreeListPtr();
+
+    FreeListPtr(std::nullptr_t);
+
+    // --------------------------
+    // creates a pointer to "ptr", which must be a segment
+    // of "pool" (or nullptr)
+    template <class Pool>
+    FreeListPtr(const Pool &pool, const Type * const ptr);
+
+    // ---------------------
+    // returns the object this pointer refers to. "pool" must
+    // be the pool the pointer was created from.
+    template <class Pool>
+    Type *get(const Pool &pool) const;
+
+    // ---------------------
+    // index of the segment in its pool. The pointer
+    // should not be null.
+    Index getIndex() const;
+
+    explicit operator bool() const;
+
+    bool operator ==(const FreeListPtr &other) const;
+
+    bool operator !=(const FreeListPtr &other) const;
+
+private:
+    // index of the segment plus one, zero means null
+    Index stored;
+};
+
+template <class Type, class Index>
+FreeListPtr <Type, Index>::FreeListPtr()
+: stored(0)
+{
+}
+
+template <class Type, class Index>
+FreeListPtr <Type, Index>::FreeListPtr(std::nullptr_t)
+: stored(0)
+{
+}
+
+template <class Type, class Index>
+    template <class Pool>
+FreeListPtr <Type, Index>::FreeListPtr(const Pool &pool,
+                                       const Type * const ptr)
+: stored(0)
+{
+    if (ptr) {
+        const size_t index = pool.getIndex(ptr);
+
+        // ----------------------
+        // check if the index fits into Index
+        assert(index < std::numeric_limits <Index>::max());
+
+        stored = static_cast <Index>(index + 1);
+    }
+}
+
+template <class Type, class Index>
+    template <class Pool>
+Type *FreeListPtr <Type, Index>::get(const Pool &pool) const
+{
+    return stored == 0 ? nullptr : pool.at(stored - 1);
+}
+
+template <class Type, class Index>
+Index FreeListPtr <Type, Index>::getIndex() const
+{
+    assert(stored != 0);
+
+    return stored - 1;
+}
+
+template <class Type, class Index>
+FreeListPtr <Type, Index>::operator bool() const
+{
+    return stored != 0;
+}
+
+template <class Type, class Index>
+bool FreeListPtr <Type, Index>::operator ==(const FreeListPtr &other) const
+{
+    return stored == other.stored;
+}
+
+template <class Type, class Index>
+bool FreeListPtr <Type, Index>::operator !=(const FreeListPtr &other) const
+{
+    return stored != other.stored;
+}
+
+#endif // FREELIST_PTR_HPP
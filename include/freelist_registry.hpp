@@ -0,0 +1,332 @@
+// Copyright 2018 Katolikian Tihran
+
+// FreeListRegistry keeps named references to pools so their
+// statistics can be dumped from a running process as JSON or
+// in the Prometheus text format. A pool is registered with
+// "add" and stays registered while the returned Registration
+// lives. Any pool with a "getStats()" method returning
+// FreeListStats can be registered.
+
+#ifndef FREELIST_REGISTRY_HPP
+#define FREELIST_REGISTRY_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "freelist.hpp"
+
+enum class FreeListDumpFormat
+{
+    json,
+    prometheus
+};
+
+class FreeListRegistry
+{
+public:
+    // --------------------------
+    // keeps a pool registered, unregisters it
+    // when destroyed
+    class Registration
+    {
+    public:
+        Registration()
+        : registry(nullptr),
+          id(0)
+        {
+        }
+
+        Registration(Registration &&rv)
+        : registry(rv.registry),
+          id(rv.id)
+        {
+            rv.registry = nullptr;
+        }
+
+        Registration &operator =(Registration &&rv)
+        {
+            if (this != &rv) {
+                reset();
+                registry = rv.registry;
+                id = rv.id;
+                rv.registry = nullptr;
+            }
+
+            return *this;
+        }
+
+        Registration(const Registration &) = delete;
+        Registration &operator =(const Registration &) = delete;
+
+        ~Registration()
+        {
+            reset();
+        }
+
+        // ---------------------
+        // unregisters the pool now
+        void reset()
+        {
+            if (registry) {
+                registry->remove(id);
+                registry = nullptr;
+            }
+        }
+
+    private:
+        friend class FreeListRegistry;
+
+        Registration(FreeListRegistry * const init_registry,
+                     const uint64_t init_id)
+        : registry(init_registry),
+          id(init_id)
+        {
+        }
+
+        FreeListRegistry *registry;
+        uint64_t id;
+    };
+
+    FreeListRegistry();
+
+    // --------------------------
+    // copy constructor is forbidden
+    FreeListRegistry(const FreeListRegistry &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for FreeListRegistry
+    FreeListRegistry &operator =(const FreeListRegistry &) = delete;
+
+    // ---------------------
+    // the registry of the process
+    static FreeListRegistry &global();
+
+    // ---------------------
+    // registers "pool" under "name". The pool should outlive
+    // the returned Registration.
+    template <class Pool>
+    Registration add(std::string name, const Pool &pool);
+
+    // ---------------------
+    // writes the statistics of all registered pools
+    // to "out"
+    void dump(std::ostream &out, const FreeListDumpFormat format) const;
+
+    // ---------------------
+    // acts as the previous one, but replaces the file "path".
+    // Throws std::runtime_error if it can not be written.
+    void dump(const std::string &path, const FreeListDumpFormat format) const;
+
+private:
+    struct Entry
+    {
+        uint64_t id;
+        std::string name;
+        std::function <FreeListStats()> stats;
+    };
+
+    mutable std::mutex registry_mutex;
+    std::vector <Entry> entries;
+    uint64_t next_id;
+
+    void remove(const uint64_t id);
+
+    // ---------------------
+    // copies names and statistics, so pools are not
+    // locked while the output is written
+    std::vector <std::pair <std::string, FreeListStats>> collect() const;
+
+    static void dumpJson(
+            std::ostream &out,
+            const std::vector <std::pair <std::string, FreeListStats>> &pools);
+
+    static void dumpPrometheus(
+            std::ostream &out,
+            const std::vector <std::pair <std::string, FreeListStats>> &pools);
+
+    // ---------------------
+    // escapes "name" for a JSON string or
+    // a Prometheus label value
+    static std::string escape(const std::string &name, const bool json);
+};
+
+inline FreeListRegistry::FreeListRegistry()
+: next_id(1)
+{
+}
+
+inline FreeListRegistry &FreeListRegistry::global()
+{
+    static FreeListRegistry registry;
+
+    return registry;
+}
+
+template <class Pool>
+FreeListRegistry::Registration FreeListRegistry::add(std::string name,
+                                                     const Pool &pool)
+{
+    std::lock_guard <std::mutex> lg(registry_mutex);
+
+    const uint64_t id = next_id++;
+
+    entries.push_back({id, std::move(name), [&pool] { return pool.getStats(); }});
+
+    return Registration(this, id);
+}
+
+inline void FreeListRegistry::dump(std::ostream &out,
+                                   const FreeListDumpFormat format) const
+{
+    const std::vector <std::pair <std::string, FreeListStats>> pools = collect();
+
+    if (format == FreeListDumpFormat::json)
+        dumpJson(out, pools);
+    else
+        dumpPrometheus(out, pools);
+}
+
+inline void FreeListRegistry::dump(const std::string &path,
+                                   const FreeListDumpFormat format) const
+{
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+
+    if (file)
+        dump(file, format);
+
+    if (!file)
+        throw std::runtime_error("FreeListRegistry can not write " + path + "\n");
+}
+
+inline void FreeListRegistry::remove(const uint64_t id)
+{
+    std::lock_guard <std::mutex> lg(registry_mutex);
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].id == id) {
+            entries.erase(entries.begin() + i);
+            return;
+        }
+    }
+}
+
+inline std::vector <std::pair <std::string, FreeListStats>>
+FreeListRegistry::collect() const
+{
+    std::vector <std::pair <std::string, FreeListStats>> pools;
+    std::lock_guard <std::mutex> lg(registry_mutex);
+
+    pools.reserve(entries.size());
+
+    for (const Entry &entry : entries)
+        pools.emplace_back(entry.name, entry.stats());
+
+    return pools;
+}
+
+inline void FreeListRegistry::dumpJson(
+        std::ostream &out,
+        const std::vector <std::pair <std::string, FreeListStats>> &pools)
+{
+    out << "{\"pools\":[";
+
+    for (size_t i = 0; i < pools.size(); ++i) {
+        const FreeListStats &stats = pools[i].second;
+
+        out << (i == 0 ? "" : ",")
+            << "{\"name\":\"" << escape(pools[i].first, true) << "\""
+            << ",\"capacity\":" << stats.capacity
+            << ",\"live\":" << stats.live
+            << ",\"peak\":" << stats.peak
+            << ",\"footprint_bytes\":" << stats.footprint
+            << ",\"fragmentation\":" << stats.fragmentation
+            << ",\"lock_waits\":" << stats.lock_waits << "}";
+    }
+
+    out << "]}\n";
+}
+
+inline void FreeListRegistry::dumpPrometheus(
+        std::ostream &out,
+        const std::vector <std::pair <std::string, FreeListStats>> &pools)
+{
+    // ----------------------
+    // counts are written as integers, big ones would turn
+    // into the exponent form as doubles
+    struct Metric
+    {
+        const char *name;
+        const char *type;
+        const char *help;
+        void (*write)(std::ostream &, const FreeListStats &);
+    };
+
+    static const Metric metrics[] = {
+        {"freelist_capacity", "gauge", "Number of objects the pool can store.",
+         [](std::ostream &out, const FreeListStats &s) { out << s.capacity; }},
+        {"freelist_live", "gauge", "Number of segments handed out.",
+         [](std::ostream &out, const FreeListStats &s) { out << s.live; }},
+        {"freelist_peak", "gauge", "Biggest number of segments handed out.",
+         [](std::ostream &out, const FreeListStats &s) { out << s.peak; }},
+        {"freelist_footprint_bytes", "gauge", "Bytes held by the pool.",
+         [](std::ostream &out, const FreeListStats &s) { out << s.footprint; }},
+        {"freelist_fragmentation", "gauge",
+         "Share of live segments outside the packed start of the pool.",
+         [](std::ostream &out, const FreeListStats &s) {
+             out << s.fragmentation;
+         }},
+        {"freelist_lock_waits_total", "counter",
+         "Times the pool lock was held by another thread.",
+         [](std::ostream &out, const FreeListStats &s) {
+             out << s.lock_waits;
+         }}
+    };
+
+    for (const Metric &metric : metrics) {
+        out << "# HELP " << metric.name << " " << metric.help << "\n"
+            << "# TYPE " << metric.name << " " << metric.type << "\n";
+
+        for (const std::pair <std::string, FreeListStats> &pool : pools) {
+            out << metric.name << "{pool=\"" << escape(pool.first, false)
+                << "\"} ";
+            metric.write(out, pool.second);
+            out << "\n";
+        }
+    }
+}
+
+inline std::string FreeListRegistry::escape(const std::string &name,
+                                            const bool json)
+{
+    static const char hex[] = "0123456789abcdef";
+    std::string escaped;
+
+    for (const char c : name) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (c == '\n') {
+            escaped += "\\n";
+        }
+        else if (json && static_cast <unsigned char>(c) < 0x20) {
+            escaped += "\\u00";
+            escaped += hex[(c >> 4) & 0xf];
+            escaped += hex[c & 0xf];
+        }
+        else {
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+#endif // FREELIST_REGISTRY_HPP
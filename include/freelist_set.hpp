@@ -0,0 +1,254 @@
+// Copyright 2018 Katolikian Tihran
+
+// FreeListSet carves one contiguous, aligned allocation into
+// a FreeList for every type of a compile-time type list.
+// All data slabs are placed next to each other (followed by
+// their free segment stacks), so related pools stay adjacent
+// in memory and a subsystem pays for a single allocation.
+
+#ifndef FREELIST_SET_HPP
+#define FREELIST_SET_HPP
+
+#include <algorithm>
+#include <array>
+#include <new>
+#include <tuple>
+#include <utility>
+
+#include "freelist.hpp"
+
+template <class ...Types>
+class FreeListSet
+{
+    static_assert(sizeof...(Types) > 0,
+                  "FreeListSet needs at least one type");
+
+public:
+    static constexpr size_t type_count = sizeof...(Types);
+
+    // --------------------------
+    // number of objects of each type, in the order
+    // of the type list
+    using Capacities = std::array <size_t, type_count>;
+
+    // --------------------------
+    // offsets of every part of the arena. Can be computed
+    // at compile time for constant capacities.
+    struct Layout
+    {
+        size_t data_offsets[type_count];
+        size_t segments_offsets[type_count];
+        size_t total_size;
+    };
+
+    // --------------------------
+    // creates a FreeList for every type of the list inside
+    // one allocation. "capacities[i]" objects of the i-th
+    // type can be stored.
+    explicit FreeListSet(const Capacities &capacities);
+
+    // --------------------------
+    // copy constructor is forbidden
+    FreeListSet(const FreeListSet &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for FreeListSet
+    FreeListSet &operator =(const FreeListSet &) = delete;
+
+    // --------------------------
+    // move constructor
+    FreeListSet(FreeListSet &&rv);
+
+    ~FreeListSet();
+
+    // ---------------------
+    // returns the FreeList of type "Type". Dispatch is
+    // resolved at compile time.
+    template <class Type>
+    FreeList <Type> &get();
+
+    template <class Type>
+    const FreeList <Type> &get() const;
+
+    // ---------------------
+    // shortcuts for the same functions of the FreeList
+    // of type "Type"
+    template <class Type>
+    Type *getFreePlace();
+
+    template <class Type, class ...Args>
+    Type *constructOnFreePlace(Args &&...args);
+
+    template <class Type>
+    void markAsFree(Type * const ptr);
+
+    template <class Type>
+    void destructAndMarkAsFree(Type * const ptr);
+
+    // ---------------------
+    // return size in bytes of the whole arena (data and
+    // free segment stacks of all pools)
+    size_t getPhysicalSize() const;
+
+    // ---------------------
+    // calculates the size of the arena for given
+    // capacities
+    static constexpr size_t calculatePhysicalSize(const Capacities &capacities);
+
+    // ---------------------
+    // calculates where every part of the arena is placed
+    static constexpr Layout calculateLayout(const Capacities &capacities);
+
+private:
+    static constexpr size_t arena_alignment =
+            std::max({alignof(char *), alignof(Types)...});
+
+    // size of the arena in bytes
+    size_t arena_size;
+    // one allocation for all pools
+    char *arena;
+    // pools working on parts of the arena
+    std::tuple <FreeList <Types>...> lists;
+
+    template <size_t ...Indices>
+    FreeListSet(const Capacities &capacities,
+                const Layout &layout,
+                std::index_sequence <Indices...>);
+
+    static constexpr size_t alignUp(const size_t offset,
+                                    const size_t alignment);
+};
+
+template <class ...Types>
+FreeListSet <Types...>::FreeListSet(const Capacities &capacities)
+: FreeListSet(capacities, calculateLayout(capacities),
+              std::index_sequence_for <Types...>())
+{
+}
+
+template <class ...Types>
+    template <size_t ...Indices>
+FreeListSet <Types...>::FreeListSet(const Capacities &capacities,
+                                    const Layout &layout,
+                                    std::index_sequence <Indices...>)
+: arena_size(layout.total_size),
+  arena(static_cast <char *>(::operator new(
+          arena_size, std::align_val_t(arena_alignment)))),
+  lists(FreeList <Types>(
+          reinterpret_cast <Types *>(arena + layout.data_offsets[Indices]),
+          reinterpret_cast <Types **>(arena + layout.segments_offsets[Indices]),
+          capacities[Indices])...)
+{
+}
+
+template <class ...Types>
+FreeListSet <Types...>::FreeListSet(FreeListSet &&rv)
+: arena_size(rv.arena_size),
+  arena(rv.arena),
+  lists(std::move(rv.lists))
+{
+    // ------------------------
+    // the arena has a new owner now
+    rv.arena = nullptr;
+}
+
+template <class ...Types>
+FreeListSet <Types...>::~FreeListSet()
+{
+    if (arena)
+        ::operator delete(arena, std::align_val_t(arena_alignment));
+}
+
+template <class ...Types>
+    template <class Type>
+FreeList <Type> &FreeListSet <Types...>::get()
+{
+    return std::get <FreeList <Type>>(lists);
+}
+
+template <class ...Types>
+    template <class Type>
+const FreeList <Type> &FreeListSet <Types...>::get() const
+{
+    return std::get <FreeList <Type>>(lists);
+}
+
+template <class ...Types>
+    template <class Type>
+Type *FreeListSet <Types...>::getFreePlace()
+{
+    return get <Type>().getFreePlace();
+}
+
+template <class ...Types>
+    template <class Type, class ...Args>
+Type *FreeListSet <Types...>::constructOnFreePlace(Args &&...args)
+{
+    return get <Type>().constructOnFreePlace(std::forward<Args>(args)...);
+}
+
+template <class ...Types>
+    template <class Type>
+void FreeListSet <Types...>::markAsFree(Type * const ptr)
+{
+    get <Type>().markAsFree(ptr);
+}
+
+template <class ...Types>
+    template <class Type>
+void FreeListSet <Types...>::destructAndMarkAsFree(Type * const ptr)
+{
+    get <Type>().destructAndMarkAsFree(ptr);
+}
+
+template <class ...Types>
+size_t FreeListSet <Types...>::getPhysicalSize() const
+{
+    return arena_size;
+}
+
+template <class ...Types>
+constexpr size_t FreeListSet <Types...>::calculatePhysicalSize(
+        const Capacities &capacities)
+{
+    return calculateLayout(capacities).total_size;
+}
+
+template <class ...Types>
+constexpr typename FreeListSet <Types...>::Layout
+FreeListSet <Types...>::calculateLayout(const Capacities &capacities)
+{
+    constexpr size_t sizes[] = {sizeof(Types)...};
+    constexpr size_t alignments[] = {alignof(Types)...};
+
+    Layout layout{};
+    size_t offset = 0;
+
+    // ----------------------
+    // data slabs go first, so the pools are adjacent
+    for (size_t i = 0; i < type_count; ++i) {
+        offset = alignUp(offset, alignments[i]);
+        layout.data_offsets[i] = offset;
+        offset += capacities[i] * sizes[i];
+    }
+
+    // ----------------------
+    // then the free segment stacks
+    for (size_t i = 0; i < type_count; ++i) {
+        offset = alignUp(offset, alignof(char *));
+        layout.segments_offsets[i] = offset;
+        offset += capacities[i] * sizeof(char *);
+    }
+
+    layout.total_size = offset;
+    return layout;
+}
+
+template <class ...Types>
+constexpr size_t FreeListSet <Types...>::alignUp(const size_t offset,
+                                                 const size_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+#endif // FREELIST_SET_HPP
@@ -0,0 +1,348 @@
+// Copyright 2018 Katolikian Tihran
+
+// IndexFreeList keeps free segments in a singly linked list
+// of indices stored apart from the data. The width of an index
+// is picked at compile time from "Capacity" (16 bits for up to
+// 65534 segments, 32 bits otherwise), so the links take a
+// quarter or a half of FreeList's pointer stack, and the free
+// state does not depend on where the data is mapped.
+//
+// With "Recycling" set, all objects are constructed once when
+// the list is created and destroyed with it: "getFreePlace"
+// returns a ready object and "markAsFree" keeps it alive.
+
+// define "FL_THREAD_SAFETY" to compile the thread safe
+// variant of this library
+
+#ifndef INDEX_FREELIST_HPP
+#define INDEX_FREELIST_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#ifdef FL_THREAD_SAFETY
+#include <mutex>
+#endif // FL_THREAD_SAFETY
+
+template <class Type, size_t Capacity, bool Recycling = false>
+class IndexFreeList
+{
+public:
+    // --------------------------
+    // the narrowest unsigned type which can store every
+    // index and the "null_index" value
+    using index_type = std::conditional_t <
+            (Capacity < std::numeric_limits <uint16_t>::max()), uint16_t,
+            std::conditional_t <
+                (Capacity < std::numeric_limits <uint32_t>::max()), uint32_t,
+                uint64_t>>;
+
+    // --------------------------
+    // marks the end of the free list
+    static constexpr index_type null_index =
+            std::numeric_limits <index_type>::max();
+
+    // --------------------------
+    // creates an IndexFreeList which can handle "Capacity"
+    // objects of type "Type"
+    IndexFreeList();
+
+    // --------------------------
+    // constructor for pre-allocated data. "init_links"
+    // should have "Capacity" elements.
+    IndexFreeList(Type * const init_data,
+                  index_type * const init_links);
+
+    // --------------------------
+    // copy constructor is forbidden
+    IndexFreeList(const IndexFreeList &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for IndexFreeList
+    IndexFreeList &operator =(const IndexFreeList &) = delete;
+
+    // --------------------------
+    // move constructor
+    IndexFreeList(IndexFreeList &&rv);
+
+    ~IndexFreeList();
+
+    // ---------------------
+    // returns index of a free segment and removes it from
+    // the free list. Throws std::runtime_error if there is
+    // no free segment.
+    index_type getFreeIndex();
+
+    // ---------------------
+    // returns the segment with "index" to the free list
+    void markAsFree(const index_type index);
+
+    // ---------------------
+    // pointer variants of the previous functions
+    Type *getFreePlace();
+
+    void markAsFree(Type * const ptr);
+
+    // ---------------------
+    // creates an object of type "Type" in place and passes
+    // "args" in its constructor. Not available when recycling.
+    template <class ...Args>
+    Type *constructOnFreePlace(Args &&...args);
+
+    // ---------------------
+    // calls destructor for the object and then calls
+    // "markAsFree" function. Not available when recycling.
+    void destructAndMarkAsFree(Type * const ptr);
+
+    // ---------------------
+    // converts between pointers and indices
+    Type *at(const index_type index) const;
+
+    index_type getIndex(const Type * const ptr) const;
+
+    // ---------------------
+    // return size in bytes allocated for
+    // data
+    static constexpr size_t getPhysicalSize();
+
+    // ---------------------
+    // return size in bytes allocated for links
+    static constexpr size_t getMetadataSize();
+
+private:
+    // this value depends on constructor called
+    // to create this instance of IndexFreeList
+    bool free_resources_on_destr;
+    // first free segment
+    index_type head;
+    // data for segments
+    char *data;
+    // index of the next free segment for every free segment
+    index_type *links;
+
+#ifdef FL_THREAD_SAFETY
+    std::mutex fl_mutex;
+#endif // FL_THREAD_SAFETY
+
+    // ---------------------
+    // links all segments into the free list and constructs
+    // the objects when recycling.
+    // Required only for initialization
+    void freeAll();
+
+    // ---------------------
+    // allocate and free memory for "size" segments
+    // aligned as "Type" requires
+    static char *allocateData(const size_t size);
+
+    static void freeData(char * const ptr);
+};
+
+template <class Type, size_t Capacity, bool Recycling>
+IndexFreeList <Type, Capacity, Recycling>::IndexFreeList()
+: free_resources_on_destr(true),
+  data(allocateData(Capacity)),
+  links(nullptr)
+{
+    try {
+        links = new index_type[Capacity];
+        freeAll();
+    }
+    catch (...) {
+        // ----------------------
+        // throw the exception to the user code
+        delete [] links;
+        freeData(data);
+        throw;
+    }
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+IndexFreeList <Type, Capacity, Recycling>::IndexFreeList(
+        Type * const init_data,
+        index_type * const init_links)
+: free_resources_on_destr(false),
+  data(reinterpret_cast <char *>(init_data)),
+  links(init_links)
+{
+    freeAll();
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+IndexFreeList <Type, Capacity, Recycling>::IndexFreeList(IndexFreeList &&rv)
+: free_resources_on_destr(rv.free_resources_on_destr),
+  head(rv.head),
+  data(rv.data),
+  links(rv.links)
+{
+    // ------------------------
+    // we dont want previous owner of resources to
+    // free it, because there is a new owner
+    rv.free_resources_on_destr = false;
+    rv.head = null_index;
+    rv.data = nullptr;
+    rv.links = nullptr;
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+IndexFreeList <Type, Capacity, Recycling>::~IndexFreeList()
+{
+    if constexpr (Recycling) {
+        if (data) {
+            for (size_t index = 0; index < Capacity; ++index)
+                at(index)->~Type();
+        }
+    }
+
+    if (free_resources_on_destr) {
+        freeData(data);
+        delete [] links;
+    }
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+typename IndexFreeList <Type, Capacity, Recycling>::index_type
+IndexFreeList <Type, Capacity, Recycling>::getFreeIndex()
+{
+#ifdef FL_THREAD_SAFETY
+    std::lock_guard <std::mutex> lg(fl_mutex);
+#endif // FL_THREAD_SAFETY
+
+    // ---------------------
+    // check is there is at least one free place
+    if (head == null_index)
+        throw std::runtime_error("IndexFreeList overflow\n");
+
+    const index_type index = head;
+    head = links[index];
+    return index;
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+void IndexFreeList <Type, Capacity, Recycling>::markAsFree(
+        const index_type index)
+{
+#ifdef FL_THREAD_SAFETY
+    std::lock_guard <std::mutex> lg(fl_mutex);
+#endif // FL_THREAD_SAFETY
+
+    assert(index < Capacity);
+
+    links[index] = head;
+    head = index;
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+Type *IndexFreeList <Type, Capacity, Recycling>::getFreePlace()
+{
+    return at(getFreeIndex());
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+void IndexFreeList <Type, Capacity, Recycling>::markAsFree(Type * const ptr)
+{
+    markAsFree(getIndex(ptr));
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+    template <class ...Args>
+Type *IndexFreeList <Type, Capacity, Recycling>::constructOnFreePlace(
+        Args &&...args)
+{
+    static_assert(!Recycling, "objects of a recycling list are "
+                              "always constructed");
+
+    return new (getFreePlace()) Type(std::forward<Args>(args)...);
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+void IndexFreeList <Type, Capacity, Recycling>::destructAndMarkAsFree(
+        Type * const ptr)
+{
+    static_assert(!Recycling, "objects of a recycling list are "
+                              "destroyed with the list");
+
+    ptr->~Type();
+    markAsFree(ptr);
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+Type *IndexFreeList <Type, Capacity, Recycling>::at(
+        const index_type index) const
+{
+    assert(index < Capacity);
+
+    return reinterpret_cast <Type *>(&data[index * sizeof(Type)]);
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+typename IndexFreeList <Type, Capacity, Recycling>::index_type
+IndexFreeList <Type, Capacity, Recycling>::getIndex(
+        const Type * const ptr) const
+{
+    // ----------------------
+    // check if adress is correct
+    assert(reinterpret_cast <const char *>(ptr) >= data);
+    assert(reinterpret_cast <const char *>(ptr) <= data +
+           (Capacity - 1) * sizeof(Type));
+
+    return static_cast <index_type>(
+            (reinterpret_cast <const char *>(ptr) - data) / sizeof(Type));
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+constexpr size_t IndexFreeList <Type, Capacity, Recycling>::getPhysicalSize()
+{
+    return Capacity * sizeof(Type);
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+constexpr size_t IndexFreeList <Type, Capacity, Recycling>::getMetadataSize()
+{
+    return Capacity * sizeof(index_type);
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+void IndexFreeList <Type, Capacity, Recycling>::freeAll()
+{
+    head = Capacity == 0 ? null_index : 0;
+
+    for (size_t index = 0; index < Capacity; ++index) {
+        links[index] = index + 1 == Capacity ?
+                       null_index : static_cast <index_type>(index + 1);
+    }
+
+    if constexpr (Recycling) {
+        size_t constructed = 0;
+
+        try {
+            for (; constructed < Capacity; ++constructed)
+                new (at(constructed)) Type();
+        }
+        catch (...) {
+            while (constructed != 0)
+                at(--constructed)->~Type();
+            throw;
+        }
+    }
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+char *IndexFreeList <Type, Capacity, Recycling>::allocateData(const size_t size)
+{
+    return static_cast <char *>(::operator new[](
+            size * sizeof(Type), std::align_val_t(alignof(Type))));
+}
+
+template <class Type, size_t Capacity, bool Recycling>
+void IndexFreeList <Type, Capacity, Recycling>::freeData(char * const ptr)
+{
+    ::operator delete[](ptr, std::align_val_t(alignof(Type)));
+}
+
+#endif // INDEX_FREELIST_HPP
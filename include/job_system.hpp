@@ -0,0 +1,594 @@
+// Copyright 2018 Katolikian Tihran
+
+// JobSystem is a work-stealing scheduler for fine-grained jobs.
+// Every worker owns a Chase-Lev deque of jobs and a FreeList of
+// job records, so creating a job never touches the heap. A job
+// finished by another worker (after being stolen) is handed back
+// to its owner through a SlotQueue of segment indices, so every
+// FreeList is only used by the thread which owns it and needs
+// no lock.
+//
+// Jobs form trees: a child keeps its parent unfinished until it
+// is done, and a continuation is started when its predecessor
+// (with all children) is done. Root jobs (created without a
+// parent) must be passed to "wait", children and continuations
+// are released automatically.
+//
+// The thread which creates the JobSystem becomes worker 0 and
+// executes jobs while it waits. Jobs may be created only from
+// that thread and from inside jobs.
+//
+// A worker which finds no job for a while sleeps on a condition
+// variable, and "run" wakes one sleeping worker. While nobody
+// sleeps, "run" only reads a counter.
+
+#ifndef JOB_SYSTEM_HPP
+#define JOB_SYSTEM_HPP
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "freelist.hpp"
+#include "slot_queue.hpp"
+
+class JobSystem
+{
+public:
+    static constexpr size_t cache_line_size = 64;
+    // --------------------------
+    // size of the buffer a job keeps its callable in
+    static constexpr size_t job_storage_size = 64;
+
+    // --------------------------
+    // record of one job. Jobs of different workers never
+    // share a cache line.
+    class alignas(cache_line_size) Job
+    {
+    private:
+        friend class JobSystem;
+
+        alignas(std::max_align_t) unsigned char storage[job_storage_size];
+        void (*invoke)(void *);
+        void (*destroy)(void *);
+        Job *parent;
+        Job *continuation;
+        // the job itself plus children which are not done
+        std::atomic <int> unfinished;
+        // the scheduler and (for root jobs) the waiting thread
+        std::atomic <int> references;
+        uint32_t owner;
+    };
+
+    // --------------------------
+    // starts "worker_count - 1" threads, the calling thread is
+    // the first worker. Every worker can keep "jobs_per_worker"
+    // jobs alive at once.
+    JobSystem(const size_t worker_count, const size_t jobs_per_worker);
+
+    // --------------------------
+    // copy constructor is forbidden
+    JobSystem(const JobSystem &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for JobSystem
+    JobSystem &operator =(const JobSystem &) = delete;
+
+    // --------------------------
+    // stops the workers. All root jobs should be
+    // waited for before.
+    ~JobSystem();
+
+    // ---------------------
+    // creates a root job which calls "fn". Throws
+    // std::runtime_error if the worker's FreeList is full.
+    template <class Function>
+    Job *create(Function &&fn);
+
+    // ---------------------
+    // creates a job which keeps "parent" unfinished
+    // until it is done. Throws as "create"; "parent" is
+    // not changed then.
+    template <class Function>
+    Job *createChild(Job * const parent, Function &&fn);
+
+    // ---------------------
+    // creates a job which is started when "predecessor" is
+    // done. Should be called before "predecessor" is run.
+    // Throws as "create"; "predecessor" is not changed then.
+    // Root jobs can not have continuations, because "wait"
+    // would not wait for them; the root should create its
+    // work as children instead.
+    template <class Function>
+    Job *createContinuation(Job * const predecessor, Function &&fn);
+
+    // ---------------------
+    // schedules the job on the current worker
+    void run(Job * const job);
+
+    // ---------------------
+    // executes other jobs until "job" and its children are
+    // done, then releases "job". Only for root jobs.
+    void wait(Job * const job);
+
+    size_t getWorkerCount() const;
+
+private:
+    // --------------------------
+    // Chase-Lev work-stealing deque of fixed capacity.
+    // The owner pushes and pops at the bottom, thieves
+    // steal from the top.
+    class Deque
+    {
+    public:
+        explicit Deque(const size_t capacity);
+
+        bool push(Job * const job);
+
+        Job *pop();
+
+        Job *steal();
+
+    private:
+        const int64_t mask;
+        std::unique_ptr <std::atomic <Job *>[]> buffer;
+        alignas(cache_line_size) std::atomic <int64_t> top;
+        alignas(cache_line_size) std::atomic <int64_t> bottom;
+    };
+
+    struct alignas(cache_line_size) Worker
+    {
+        Worker(const uint32_t init_index, const size_t jobs);
+
+        const uint32_t index;
+        // job records of this worker, used only by its thread
+        FreeList <Job> jobs;
+        // jobs finished by other workers, to be returned to "jobs"
+        SlotQueue <uint32_t> returned;
+        Deque deque;
+        // state of the victim choosing generator
+        uint64_t random_state;
+        std::thread thread;
+    };
+
+    // number of times a worker finds no job before it sleeps
+    static constexpr size_t idle_spins = 64;
+
+    std::vector <std::unique_ptr <Worker>> workers;
+    std::atomic <bool> running;
+    // number of sleeping workers
+    std::atomic <size_t> sleeping;
+    // increased (under sleep_mutex) to wake sleeping workers
+    std::atomic <uint64_t> wakeups;
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+
+    inline static thread_local Worker *current_worker = nullptr;
+
+    template <class Function>
+    Job *allocate(Function &&fn, Job * const parent);
+
+    void workerLoop(Worker * const worker);
+
+    // ---------------------
+    // sleeps until "run" wakes the worker or the JobSystem
+    // stops, unless a job turns up meanwhile
+    void park(Worker * const worker);
+
+    // ---------------------
+    // wakes a sleeping worker, if there is one
+    void wakeOne();
+
+    // ---------------------
+    // takes a job from the own deque or steals one
+    Job *findJob(Worker * const worker);
+
+    void execute(Job * const job);
+
+    void finish(Job * const job);
+
+    void release(Job * const job);
+
+    // ---------------------
+    // returns jobs finished by other workers to the
+    // FreeList of "worker"
+    static void collectReturned(Worker * const worker);
+};
+
+inline JobSystem::Deque::Deque(const size_t capacity)
+: mask(static_cast <int64_t>(capacity) - 1),
+  buffer(new std::atomic <Job *>[capacity]),
+  top(0),
+  bottom(0)
+{
+    assert((capacity & (capacity - 1)) == 0);
+}
+
+inline bool JobSystem::Deque::push(Job * const job)
+{
+    const int64_t b = bottom.load(std::memory_order_relaxed);
+    const int64_t t = top.load(std::memory_order_acquire);
+
+    if (b - t > mask)
+        return false;
+
+    buffer[b & mask].store(job, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_seq_cst);
+    return true;
+}
+
+inline JobSystem::Job *JobSystem::Deque::pop()
+{
+    const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+
+    // ----------------------
+    // the store must not be reordered with the load of
+    // "top", so both are sequentially consistent
+    bottom.store(b, std::memory_order_seq_cst);
+
+    int64_t t = top.load(std::memory_order_seq_cst);
+
+    if (t > b) {
+        // ----------------------
+        // the deque is empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job *job = buffer[b & mask].load(std::memory_order_relaxed);
+
+    if (t == b) {
+        // ----------------------
+        // the last job: race with thieves for it
+        if (!top.compare_exchange_strong(t, t + 1,
+                                         std::memory_order_seq_cst,
+                                         std::memory_order_relaxed))
+            job = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    return job;
+}
+
+inline JobSystem::Job *JobSystem::Deque::steal()
+{
+    int64_t t = top.load(std::memory_order_seq_cst);
+    const int64_t b = bottom.load(std::memory_order_seq_cst);
+
+    if (t >= b)
+        return nullptr;
+
+    Job * const job = buffer[t & mask].load(std::memory_order_relaxed);
+
+    if (!top.compare_exchange_strong(t, t + 1,
+                                     std::memory_order_seq_cst,
+                                     std::memory_order_relaxed))
+        return nullptr;
+
+    return job;
+}
+
+inline JobSystem::Worker::Worker(const uint32_t init_index,
+                                 const size_t jobs_count)
+: index(init_index),
+  jobs(jobs_count),
+  returned(jobs_count),
+  deque(returned.getCapacity()),
+  random_state(0x9E3779B97F4A7C15ull * (init_index + 1))
+{
+}
+
+inline JobSystem::JobSystem(const size_t worker_count,
+                            const size_t jobs_per_worker)
+: running(true),
+  sleeping(0),
+  wakeups(0)
+{
+    assert(worker_count != 0);
+    assert(current_worker == nullptr);
+
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers.emplace_back(new Worker(static_cast <uint32_t>(i),
+                                        jobs_per_worker));
+    }
+
+    current_worker = workers[0].get();
+
+    for (size_t i = 1; i < worker_count; ++i) {
+        Worker * const worker = workers[i].get();
+        worker->thread = std::thread(&JobSystem::workerLoop, this, worker);
+    }
+}
+
+inline JobSystem::~JobSystem()
+{
+    running.store(false, std::memory_order_release);
+
+    // ----------------------
+    // a worker checks "running" with the mutex held, so after
+    // it is taken every sleeping worker sees the change
+    {
+        std::lock_guard <std::mutex> lg(sleep_mutex);
+    }
+    sleep_cv.notify_all();
+
+    for (size_t i = 1; i < workers.size(); ++i)
+        workers[i]->thread.join();
+
+    current_worker = nullptr;
+}
+
+template <class Function>
+JobSystem::Job *JobSystem::create(Function &&fn)
+{
+    Job * const job = allocate(std::forward<Function>(fn), nullptr);
+
+    // ----------------------
+    // one more reference for the thread which waits
+    job->references.store(2, std::memory_order_relaxed);
+    return job;
+}
+
+template <class Function>
+JobSystem::Job *JobSystem::createChild(Job * const parent, Function &&fn)
+{
+    assert(parent);
+
+    // ----------------------
+    // "parent" is counted only after the job exists: a
+    // failed allocation must not keep it unfinished
+    Job * const job = allocate(std::forward<Function>(fn), parent);
+
+    parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    return job;
+}
+
+template <class Function>
+JobSystem::Job *JobSystem::createContinuation(Job * const predecessor,
+                                              Function &&fn)
+{
+    assert(predecessor && !predecessor->continuation);
+    assert(predecessor->parent);
+
+    Job * const parent = predecessor->parent;
+    Job * const job = allocate(std::forward<Function>(fn), parent);
+
+    if (parent)
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+
+    predecessor->continuation = job;
+    return job;
+}
+
+inline void JobSystem::run(Job * const job)
+{
+    assert(current_worker);
+
+    // ----------------------
+    // the deque is full: do not wait for space
+    if (!current_worker->deque.push(job)) {
+        execute(job);
+        return;
+    }
+
+    wakeOne();
+}
+
+inline void JobSystem::wait(Job * const job)
+{
+    assert(current_worker && !job->parent);
+
+    while (job->unfinished.load(std::memory_order_acquire) != 0) {
+        if (Job * const other = findJob(current_worker))
+            execute(other);
+        else
+            std::this_thread::yield();
+    }
+
+    release(job);
+}
+
+inline size_t JobSystem::getWorkerCount() const
+{
+    return workers.size();
+}
+
+template <class Function>
+JobSystem::Job *JobSystem::allocate(Function &&fn, Job * const parent)
+{
+    using Callable = std::decay_t <Function>;
+
+    static_assert(sizeof(Callable) <= job_storage_size,
+                  "the callable does not fit into a job");
+    static_assert(alignof(Callable) <= alignof(std::max_align_t),
+                  "the callable is over-aligned");
+
+    Worker * const worker = current_worker;
+
+    assert(worker);
+
+    collectReturned(worker);
+
+    Job * const job = new (worker->jobs.getFreePlace()) Job;
+
+    try {
+        new (job->storage) Callable(std::forward<Function>(fn));
+    }
+    catch (...) {
+        worker->jobs.markAsFree(job);
+        throw;
+    }
+
+    job->invoke = [](void * const storage) {
+        (*static_cast <Callable *>(storage))();
+    };
+    job->destroy = [](void * const storage) {
+        static_cast <Callable *>(storage)->~Callable();
+    };
+    job->parent = parent;
+    job->continuation = nullptr;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    job->references.store(1, std::memory_order_relaxed);
+    job->owner = worker->index;
+    return job;
+}
+
+inline void JobSystem::workerLoop(Worker * const worker)
+{
+    current_worker = worker;
+
+    size_t idle = 0;
+
+    while (running.load(std::memory_order_acquire)) {
+        collectReturned(worker);
+
+        if (Job * const job = findJob(worker)) {
+            execute(job);
+            idle = 0;
+        }
+        else if (++idle < idle_spins) {
+            std::this_thread::yield();
+        }
+        else {
+            park(worker);
+            idle = 0;
+        }
+    }
+
+    current_worker = nullptr;
+}
+
+inline void JobSystem::park(Worker * const worker)
+{
+    const uint64_t seen = wakeups.load(std::memory_order_seq_cst);
+
+    sleeping.fetch_add(1, std::memory_order_seq_cst);
+
+    // ----------------------
+    // a job pushed before "sleeping" was increased is found
+    // here, "run" of a later one sees the sleeper and wakes it
+    if (Job * const job = findJob(worker)) {
+        sleeping.fetch_sub(1, std::memory_order_relaxed);
+        execute(job);
+        return;
+    }
+
+    {
+        std::unique_lock <std::mutex> lock(sleep_mutex);
+
+        sleep_cv.wait(lock, [this, seen] {
+            return wakeups.load(std::memory_order_relaxed) != seen ||
+                   !running.load(std::memory_order_acquire);
+        });
+    }
+
+    sleeping.fetch_sub(1, std::memory_order_relaxed);
+}
+
+inline void JobSystem::wakeOne()
+{
+    if (sleeping.load(std::memory_order_seq_cst) == 0)
+        return;
+
+    {
+        std::lock_guard <std::mutex> lg(sleep_mutex);
+
+        wakeups.fetch_add(1, std::memory_order_relaxed);
+    }
+    sleep_cv.notify_one();
+}
+
+inline JobSystem::Job *JobSystem::findJob(Worker * const worker)
+{
+    if (Job * const job = worker->deque.pop())
+        return job;
+
+    const size_t count = workers.size();
+
+    if (count == 1)
+        return nullptr;
+
+    // ----------------------
+    // xorshift chooses where to start stealing
+    uint64_t &state = worker->random_state;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    const size_t first = state % count;
+
+    for (size_t i = 0; i < count; ++i) {
+        Worker * const victim = workers[(first + i) % count].get();
+
+        if (victim == worker)
+            continue;
+        if (Job * const job = victim->deque.steal())
+            return job;
+    }
+
+    return nullptr;
+}
+
+inline void JobSystem::execute(Job * const job)
+{
+    job->invoke(job->storage);
+    job->destroy(job->storage);
+    finish(job);
+}
+
+inline void JobSystem::finish(Job * const job)
+{
+    if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    Job * const parent = job->parent;
+    Job * const continuation = job->continuation;
+
+    release(job);
+
+    if (continuation)
+        run(continuation);
+    if (parent)
+        finish(parent);
+}
+
+inline void JobSystem::release(Job * const job)
+{
+    if (job->references.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    Worker * const owner = workers[job->owner].get();
+
+    if (owner == current_worker) {
+        owner->jobs.markAsFree(job);
+        return;
+    }
+
+    // ----------------------
+    // the queue has room for every job of the owner,
+    // so this never fails
+    const bool pushed = owner->returned.tryPush(
+            static_cast <uint32_t>(owner->jobs.getIndex(job)));
+
+    assert(pushed);
+    (void) pushed;
+}
+
+inline void JobSystem::collectReturned(Worker * const worker)
+{
+    uint32_t index;
+
+    while (worker->returned.tryPop(index))
+        worker->jobs.markAsFree(worker->jobs.at(index));
+}
+
+#endif // JOB_SYSTEM_HPP
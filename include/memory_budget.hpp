@@ -0,0 +1,209 @@
+// Copyright 2018 Katolikian Tihran
+
+// MemoryBudget caps the memory held by a group of pools.
+// A FreeList created with a budget charges it for its data
+// and free segments before allocating them and credits it
+// when destroyed. Budgets can be nested (a subsystem budget
+// charging a process-wide one). When the usage crosses the
+// soft limit, registered callbacks are called, so idle pools
+// can be released before the hard limit is hit.
+
+#ifndef MEMORY_BUDGET_HPP
+#define MEMORY_BUDGET_HPP
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// --------------------------
+// thrown when a budget would exceed its hard limit
+class MemoryBudgetExceeded : public std::bad_alloc
+{
+public:
+    const char *what() const noexcept override
+    {
+        return "MemoryBudget hard limit exceeded";
+    }
+};
+
+class MemoryBudget
+{
+public:
+    using Callback = std::function <void(MemoryBudget &)>;
+
+    // --------------------------
+    // creates a budget of "init_hard_limit" bytes. Callbacks
+    // are called when the usage reaches "init_soft_limit".
+    // Every charge is passed to "init_parent" as well.
+    explicit MemoryBudget(
+            const size_t init_hard_limit,
+            const size_t init_soft_limit = std::numeric_limits <size_t>::max(),
+            MemoryBudget * const init_parent = nullptr);
+
+    // --------------------------
+    // copy constructor is forbidden
+    MemoryBudget(const MemoryBudget &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for MemoryBudget
+    MemoryBudget &operator =(const MemoryBudget &) = delete;
+
+    // ---------------------
+    // charges "bytes". Returns false (and charges nothing)
+    // if this budget or one of its parents would exceed
+    // the hard limit.
+    bool tryCharge(const size_t bytes);
+
+    // ---------------------
+    // acts as the previous one, but throws
+    // MemoryBudgetExceeded instead of returning false
+    void charge(const size_t bytes);
+
+    // ---------------------
+    // gives "bytes" back to this budget and its parents
+    void credit(const size_t bytes);
+
+    // ---------------------
+    // "callback" is called each time the usage grows
+    // over the soft limit
+    void addSoftLimitCallback(Callback callback);
+
+    size_t getUsed() const;
+
+    size_t getPeak() const;
+
+    size_t getRefusals() const;
+
+    size_t getHardLimit() const;
+
+    size_t getSoftLimit() const;
+
+private:
+    const size_t hard_limit;
+    const size_t soft_limit;
+    MemoryBudget * const parent;
+
+    std::atomic <size_t> used;
+    std::atomic <size_t> peak;
+    std::atomic <size_t> refusals;
+
+    std::mutex callbacks_mutex;
+    std::vector <Callback> callbacks;
+
+    void notifySoftLimit();
+};
+
+inline MemoryBudget::MemoryBudget(const size_t init_hard_limit,
+                                  const size_t init_soft_limit,
+                                  MemoryBudget * const init_parent)
+: hard_limit(init_hard_limit),
+  soft_limit(init_soft_limit),
+  parent(init_parent),
+  used(0),
+  peak(0),
+  refusals(0)
+{
+}
+
+inline bool MemoryBudget::tryCharge(const size_t bytes)
+{
+    size_t before = used.load(std::memory_order_relaxed);
+
+    do {
+        if (bytes > hard_limit - before) {
+            refusals.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    } while (!used.compare_exchange_weak(before, before + bytes,
+                                         std::memory_order_relaxed));
+
+    if (parent && !parent->tryCharge(bytes)) {
+        used.fetch_sub(bytes, std::memory_order_relaxed);
+        refusals.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    const size_t after = before + bytes;
+    size_t current_peak = peak.load(std::memory_order_relaxed);
+
+    while (current_peak < after &&
+           !peak.compare_exchange_weak(current_peak, after,
+                                       std::memory_order_relaxed)) {
+    }
+
+    if (before < soft_limit && after >= soft_limit)
+        notifySoftLimit();
+
+    return true;
+}
+
+inline void MemoryBudget::charge(const size_t bytes)
+{
+    if (!tryCharge(bytes))
+        throw MemoryBudgetExceeded();
+}
+
+inline void MemoryBudget::credit(const size_t bytes)
+{
+    assert(used.load(std::memory_order_relaxed) >= bytes);
+
+    used.fetch_sub(bytes, std::memory_order_relaxed);
+
+    if (parent)
+        parent->credit(bytes);
+}
+
+inline void MemoryBudget::addSoftLimitCallback(Callback callback)
+{
+    std::lock_guard <std::mutex> lg(callbacks_mutex);
+
+    callbacks.push_back(std::move(callback));
+}
+
+inline size_t MemoryBudget::getUsed() const
+{
+    return used.load(std::memory_order_relaxed);
+}
+
+inline size_t MemoryBudget::getPeak() const
+{
+    return peak.load(std::memory_order_relaxed);
+}
+
+inline size_t MemoryBudget::getRefusals() const
+{
+    return refusals.load(std::memory_order_relaxed);
+}
+
+inline size_t MemoryBudget::getHardLimit() const
+{
+    return hard_limit;
+}
+
+inline size_t MemoryBudget::getSoftLimit() const
+{
+    return soft_limit;
+}
+
+inline void MemoryBudget::notifySoftLimit()
+{
+    std::vector <Callback> to_call;
+
+    {
+        std::lock_guard <std::mutex> lg(callbacks_mutex);
+        to_call = callbacks;
+    }
+
+    // ----------------------
+    // called without the lock, so callbacks may release
+    // pools or charge the budget again
+    for (Callback &callback : to_call)
+        callback(*this);
+}
+
+#endif // MEMORY_BUDGET_HPP
@@ -0,0 +1,218 @@
+// Copyright 2018 Katolikian Tihran
+
+// OccupancyMap is a snapshot of how live objects spread over
+// the data of a pool (FreeList or BitmapFreeList), counted per
+// region of "region_size" bytes - a cache line or a page. It can
+// be written as one line of a heatmap (a character per region,
+// so lines appended periodically show the pool over time) or as
+// a histogram of regions by occupancy, and gives a single
+// fragmentation score.
+//
+// A segment belongs to the region its first byte is in.
+
+#ifndef OCCUPANCY_MAP_HPP
+#define OCCUPANCY_MAP_HPP
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+
+class OccupancyMap
+{
+public:
+    // ---------------------
+    // counts live objects of "pool" in regions of
+    // "region_size" bytes. Takes O(size) time and memory
+    // of the pool; the pool is locked only while its free
+    // segments are copied.
+    template <class Pool>
+    static OccupancyMap capture(const Pool &pool,
+                                const size_t region_size = 4096);
+
+    size_t getRegionSize() const;
+
+    size_t getRegionCount() const;
+
+    // ---------------------
+    // number of live objects and of all segments
+    // in region "region"
+    size_t getOccupied(const size_t region) const;
+
+    size_t getCapacity(const size_t region) const;
+
+    size_t getLiveCount() const;
+
+    // ---------------------
+    // milliseconds of std::chrono::system_clock when
+    // the snapshot was taken
+    uint64_t getTimestamp() const;
+
+    // ---------------------
+    // 0 if live objects fill as few regions as they could,
+    // close to 1 if they are spread one per region
+    double getFragmentationScore() const;
+
+    // ---------------------
+    // writes "<timestamp> <live> <score> <regions>" where every
+    // region is one of " .:-=+*#%@" from empty to full
+    void writeHeatmapLine(std::ostream &out) const;
+
+    // ---------------------
+    // writes the number of regions which are empty, full
+    // and filled by 1-10%, 11-20%, ... 91-99%
+    void writeHistogram(std::ostream &out) const;
+
+private:
+    size_t region_size;
+    size_t live;
+    uint64_t timestamp;
+    std::vector <uint32_t> occupied;
+    std::vector <uint32_t> capacity;
+
+    OccupancyMap(const size_t init_region_size, const size_t region_count);
+};
+
+template <class Pool>
+OccupancyMap OccupancyMap::capture(const Pool &pool, const size_t region_size)
+{
+    using Type = typename std::remove_pointer <
+            decltype(pool.at(0))>::type;
+
+    // ----------------------
+    // segments may be padded, so the distance between them
+    // is taken from the pool
+    const size_t list_size = pool.getPhysicalSize() /
+                             Pool::calculatePhysicalSize(1);
+
+    if (list_size == 0)
+        return OccupancyMap(region_size, 0);
+
+    const uintptr_t base = reinterpret_cast <uintptr_t>(pool.at(0));
+    const uintptr_t first_region = base / region_size;
+
+    auto regionOf = [first_region, region_size](const Type * const ptr) {
+        return reinterpret_cast <uintptr_t>(ptr) / region_size - first_region;
+    };
+
+    OccupancyMap map(region_size, regionOf(pool.at(list_size - 1)) + 1);
+
+    for (size_t index = 0; index < list_size; ++index)
+        ++map.capacity[regionOf(pool.at(index))];
+
+    pool.forEachOccupied([&map, &regionOf](const size_t, const Type * const ptr) {
+        ++map.occupied[regionOf(ptr)];
+        ++map.live;
+    });
+
+    return map;
+}
+
+inline OccupancyMap::OccupancyMap(const size_t init_region_size,
+                                  const size_t region_count)
+: region_size(init_region_size),
+  live(0),
+  timestamp(static_cast <uint64_t>(
+          std::chrono::duration_cast <std::chrono::milliseconds>(
+                  std::chrono::system_clock::now().time_since_epoch()).count())),
+  occupied(region_count, 0),
+  capacity(region_count, 0)
+{
+}
+
+inline size_t OccupancyMap::getRegionSize() const
+{
+    return region_size;
+}
+
+inline size_t OccupancyMap::getRegionCount() const
+{
+    return occupied.size();
+}
+
+inline size_t OccupancyMap::getOccupied(const size_t region) const
+{
+    return occupied[region];
+}
+
+inline size_t OccupancyMap::getCapacity(const size_t region) const
+{
+    return capacity[region];
+}
+
+inline size_t OccupancyMap::getLiveCount() const
+{
+    return live;
+}
+
+inline uint64_t OccupancyMap::getTimestamp() const
+{
+    return timestamp;
+}
+
+inline double OccupancyMap::getFragmentationScore() const
+{
+    size_t touched = 0;
+    size_t segments = 0;
+
+    for (size_t region = 0; region < occupied.size(); ++region) {
+        touched += occupied[region] != 0;
+        segments += capacity[region];
+    }
+
+    if (touched <= 1)
+        return 0.0;
+
+    // ----------------------
+    // regions needed if live objects were packed
+    const double needed = std::ceil(double(live) * double(occupied.size()) /
+                                    double(segments));
+    const double score = 1.0 - needed / double(touched);
+
+    return score < 0.0 ? 0.0 : score;
+}
+
+inline void OccupancyMap::writeHeatmapLine(std::ostream &out) const
+{
+    static const char levels[] = " .:-=+*#%@";
+
+    out << timestamp << " " << live << " " << getFragmentationScore() << " ";
+
+    for (size_t region = 0; region < occupied.size(); ++region) {
+        if (occupied[region] == 0)
+            out << levels[0];
+        else
+            out << levels[1 + occupied[region] * 8 / capacity[region]];
+    }
+
+    out << "\n";
+}
+
+inline void OccupancyMap::writeHistogram(std::ostream &out) const
+{
+    size_t empty = 0;
+    size_t full = 0;
+    size_t partial[10] = {};
+
+    for (size_t region = 0; region < occupied.size(); ++region) {
+        if (occupied[region] == 0)
+            ++empty;
+        else if (occupied[region] == capacity[region])
+            ++full;
+        else
+            ++partial[(occupied[region] * 10 - 1) / capacity[region]];
+    }
+
+    out << "empty " << empty << "\n";
+
+    for (size_t bucket = 0; bucket < 10; ++bucket) {
+        out << bucket * 10 + 1 << "-" << (bucket == 9 ? 99 : bucket * 10 + 10)
+            << "% " << partial[bucket] << "\n";
+    }
+
+    out << "full " << full << "\n";
+}
+
+#endif // OCCUPANCY_MAP_HPP
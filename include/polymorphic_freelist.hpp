@@ -0,0 +1,140 @@
+// Copyright 2018 Katolikian Tihran
+
+// PolymorphicFreeList keeps objects of a whole class
+// hierarchy in one FreeList. Every slot is sized and aligned
+// for the largest listed type, so mixed-type allocations
+// share a single dense slab and are destroyed through
+// pointers to the base class.
+
+#ifndef POLYMORPHIC_FREELIST_HPP
+#define POLYMORPHIC_FREELIST_HPP
+
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "freelist.hpp"
+
+template <class Base, class ...Derived>
+class PolymorphicFreeList
+{
+    static_assert(sizeof...(Derived) > 0,
+                  "PolymorphicFreeList needs at least one type");
+    static_assert((std::is_base_of<Base, Derived>::value && ...),
+                  "every listed type must derive from Base");
+    static_assert(std::has_virtual_destructor<Base>::value,
+                  "Base must have a virtual destructor");
+
+public:
+    // --------------------------
+    // size and alignment of one slot: enough to hold
+    // any of the listed types
+    static constexpr size_t slot_size = std::max({sizeof(Derived)...});
+    static constexpr size_t slot_alignment = std::max({alignof(Derived)...});
+
+    // --------------------------
+    // creates a PolymorphicFreeList which can handle
+    // "init_list_size" objects of any listed type
+    explicit PolymorphicFreeList(const size_t init_list_size);
+
+    // --------------------------
+    // copy constructor is forbidden
+    PolymorphicFreeList(const PolymorphicFreeList &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for PolymorphicFreeList
+    PolymorphicFreeList &operator =(const PolymorphicFreeList &) = delete;
+
+    // --------------------------
+    // move constructor
+    PolymorphicFreeList(PolymorphicFreeList &&rv) = default;
+
+    // ---------------------
+    // creates an object of type "Type" (which must be one of
+    // the listed types) on a free slot and passes "args"
+    // in its constructor. The slot is returned to the list
+    // if the constructor throws.
+    template <class Type, class ...Args>
+    Type *constructOnFreePlace(Args &&...args);
+
+    // ---------------------
+    // calls the (virtual) destructor of the object and marks
+    // its slot as free. "ptr" may point to any base subobject
+    // of an object created by this list.
+    void destructAndMarkAsFree(Base * const ptr);
+
+    // ---------------------
+    // return size in bytes allocated for
+    // data
+    size_t getPhysicalSize() const;
+
+    // ---------------------
+    // calculates the size will be allocated for data in
+    // list of "size" elements
+    static size_t calculatePhysicalSize(const size_t size);
+
+private:
+    // storage for one object of any listed type
+    struct Slot
+    {
+        alignas(Derived...) unsigned char storage[slot_size];
+    };
+
+    FreeList <Slot> slots;
+};
+
+template <class Base, class ...Derived>
+PolymorphicFreeList <Base, Derived...>::PolymorphicFreeList(
+        const size_t init_list_size)
+: slots(init_list_size)
+{
+}
+
+template <class Base, class ...Derived>
+    template <class Type, class ...Args>
+Type *PolymorphicFreeList <Base, Derived...>::constructOnFreePlace(
+        Args &&...args)
+{
+    static_assert((std::is_same<Type, Derived>::value || ...),
+                  "Type is not listed in this PolymorphicFreeList");
+
+    Slot * const slot = slots.getFreePlace();
+
+    try {
+        return new (slot) Type(std::forward<Args>(args)...);
+    }
+    catch (...) {
+        slots.markAsFree(slot);
+        throw;
+    }
+}
+
+template <class Base, class ...Derived>
+void PolymorphicFreeList <Base, Derived...>::destructAndMarkAsFree(
+        Base * const ptr)
+{
+    // ----------------------
+    // the most derived object starts at the beginning
+    // of its slot, even if "ptr" points to a base
+    // subobject with a non-zero offset
+    Slot * const slot = static_cast <Slot *>(dynamic_cast <void *>(ptr));
+
+    ptr->~Base();
+    slots.markAsFree(slot);
+}
+
+template <class Base, class ...Derived>
+size_t PolymorphicFreeList <Base, Derived...>::getPhysicalSize() const
+{
+    return slots.getPhysicalSize();
+}
+
+template <class Base, class ...Derived>
+size_t PolymorphicFreeList <Base, Derived...>::calculatePhysicalSize(
+        const size_t size)
+{
+    return FreeList <Slot>::calculatePhysicalSize(size);
+}
+
+#endif // POLYMORPHIC_FREELIST_HPP
@@ -0,0 +1,817 @@
+// Copyright 2018 Katolikian Tihran
+
+// Node based containers whose nodes live in a FreeList:
+//   PooledList     - doubly linked list
+//   PooledQueue    - FIFO queue
+//   PooledHashMap  - hash map with chained nodes
+// Every container either owns its FreeList (created from a
+// capacity) or takes nodes from a FreeList shared with other
+// containers of the same type. With "Index" set to an unsigned
+// integer type, links between nodes are stored as FreeListPtr
+// instead of pointers.
+
+#ifndef POOLED_CONTAINERS_HPP
+#define POOLED_CONTAINERS_HPP
+
+#include <cassert>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "freelist.hpp"
+#include "freelist_ptr.hpp"
+
+// --------------------------
+// how nodes refer to each other: compact indices
+template <class Node, class Index>
+struct PooledLink
+{
+    using type = FreeListPtr <Node, Index>;
+
+    static Node *get(const type &link, const FreeList <Node> &pool)
+    {
+        return link.get(pool);
+    }
+
+    static type make(const FreeList <Node> &pool, Node * const node)
+    {
+        return type(pool, node);
+    }
+};
+
+// --------------------------
+// ... or plain pointers
+template <class Node>
+struct PooledLink <Node, void>
+{
+    using type = Node *;
+
+    static Node *get(const type &link, const FreeList <Node> &)
+    {
+        return link;
+    }
+
+    static type make(const FreeList <Node> &, Node * const node)
+    {
+        return node;
+    }
+};
+
+// --------------------------
+// owned or shared FreeList of nodes together with
+// helpers every container needs
+template <class Node, class Index>
+class PooledNodes
+{
+public:
+    using Link = PooledLink <Node, Index>;
+    using link_type = typename Link::type;
+
+    explicit PooledNodes(const size_t capacity)
+    : owned_pool(new FreeList <Node>(capacity)),
+      pool(owned_pool.get())
+    {
+    }
+
+    explicit PooledNodes(FreeList <Node> &shared_pool)
+    : pool(&shared_pool)
+    {
+    }
+
+    template <class ...Args>
+    Node *create(Args &&...args)
+    {
+        Node * const node = pool->getFreePlace();
+
+        try {
+            return new (node) Node(std::forward<Args>(args)...);
+        }
+        catch (...) {
+            pool->markAsFree(node);
+            throw;
+        }
+    }
+
+    void destroy(Node * const node)
+    {
+        pool->destructAndMarkAsFree(node);
+    }
+
+    Node *get(const link_type &link) const
+    {
+        return Link::get(link, *pool);
+    }
+
+    link_type link(Node * const node) const
+    {
+        return Link::make(*pool, node);
+    }
+
+private:
+    std::unique_ptr <FreeList <Node>> owned_pool;
+    FreeList <Node> *pool;
+};
+
+template <class Type, class Index = void>
+class PooledList
+{
+public:
+    // --------------------------
+    // node of the list, exposed for creating
+    // shared FreeLists
+    struct Node
+    {
+        template <class ...Args>
+        explicit Node(Args &&...args)
+        : value(std::forward<Args>(args)...)
+        {
+        }
+
+        Type value;
+        typename PooledLink <Node, Index>::type prev{};
+        typename PooledLink <Node, Index>::type next{};
+    };
+
+    class Iterator
+    {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Type *;
+        using reference = Type &;
+
+        Type &operator *() const { return node->value; }
+        Type *operator ->() const { return &node->value; }
+
+        Iterator &operator ++()
+        {
+            node = list->nodes.get(node->next);
+            return *this;
+        }
+
+        Iterator &operator --()
+        {
+            node = node ? list->nodes.get(node->prev) : list->tail;
+            return *this;
+        }
+
+        bool operator ==(const Iterator &other) const { return node == other.node; }
+        bool operator !=(const Iterator &other) const { return node != other.node; }
+
+    private:
+        friend class PooledList;
+
+        Iterator(const PooledList * const init_list, Node * const init_node)
+        : list(init_list), node(init_node)
+        {
+        }
+
+        const PooledList *list;
+        Node *node;
+    };
+
+    // --------------------------
+    // creates a list with its own FreeList for
+    // "capacity" nodes
+    explicit PooledList(const size_t capacity);
+
+    // --------------------------
+    // creates a list taking nodes from "shared_pool"
+    explicit PooledList(FreeList <Node> &shared_pool);
+
+    // --------------------------
+    // copy constructor is forbidden
+    PooledList(const PooledList &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for PooledList
+    PooledList &operator =(const PooledList &) = delete;
+
+    ~PooledList();
+
+    // ---------------------
+    // add an element at the end or at the beginning
+    // of the list, constructed from "args"
+    template <class ...Args>
+    Type &emplaceBack(Args &&...args);
+
+    template <class ...Args>
+    Type &emplaceFront(Args &&...args);
+
+    void pushBack(const Type &value);
+
+    void pushFront(const Type &value);
+
+    // ---------------------
+    // inserts an element before "position"
+    template <class ...Args>
+    Iterator emplace(const Iterator position, Args &&...args);
+
+    // ---------------------
+    // removes the element at "position" and returns
+    // iterator to the next one
+    Iterator erase(const Iterator position);
+
+    void popBack();
+
+    void popFront();
+
+    Type &front() const;
+
+    Type &back() const;
+
+    Iterator begin() const;
+
+    Iterator end() const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    void clear();
+
+private:
+    PooledNodes <Node, Index> nodes;
+    Node *head;
+    Node *tail;
+    size_t element_count;
+};
+
+template <class Type, class Index>
+PooledList <Type, Index>::PooledList(const size_t capacity)
+: nodes(capacity),
+  head(nullptr),
+  tail(nullptr),
+  element_count(0)
+{
+}
+
+template <class Type, class Index>
+PooledList <Type, Index>::PooledList(FreeList <Node> &shared_pool)
+: nodes(shared_pool),
+  head(nullptr),
+  tail(nullptr),
+  element_count(0)
+{
+}
+
+template <class Type, class Index>
+PooledList <Type, Index>::~PooledList()
+{
+    clear();
+}
+
+template <class Type, class Index>
+    template <class ...Args>
+Type &PooledList <Type, Index>::emplaceBack(Args &&...args)
+{
+    return *emplace(end(), std::forward<Args>(args)...);
+}
+
+template <class Type, class Index>
+    template <class ...Args>
+Type &PooledList <Type, Index>::emplaceFront(Args &&...args)
+{
+    return *emplace(begin(), std::forward<Args>(args)...);
+}
+
+template <class Type, class Index>
+void PooledList <Type, Index>::pushBack(const Type &value)
+{
+    emplaceBack(value);
+}
+
+template <class Type, class Index>
+void PooledList <Type, Index>::pushFront(const Type &value)
+{
+    emplaceFront(value);
+}
+
+template <class Type, class Index>
+    template <class ...Args>
+typename PooledList <Type, Index>::Iterator
+PooledList <Type, Index>::emplace(const Iterator position, Args &&...args)
+{
+    Node * const node = nodes.create(std::forward<Args>(args)...);
+    Node * const next = position.node;
+    Node * const prev = next ? nodes.get(next->prev) : tail;
+
+    node->prev = nodes.link(prev);
+    node->next = nodes.link(next);
+
+    if (prev)
+        prev->next = nodes.link(node);
+    else
+        head = node;
+
+    if (next)
+        next->prev = nodes.link(node);
+    else
+        tail = node;
+
+    ++element_count;
+    return Iterator(this, node);
+}
+
+template <class Type, class Index>
+typename PooledList <Type, Index>::Iterator
+PooledList <Type, Index>::erase(const Iterator position)
+{
+    assert(position.node);
+
+    Node * const node = position.node;
+    Node * const prev = nodes.get(node->prev);
+    Node * const next = nodes.get(node->next);
+
+    if (prev)
+        prev->next = node->next;
+    else
+        head = next;
+
+    if (next)
+        next->prev = node->prev;
+    else
+        tail = prev;
+
+    nodes.destroy(node);
+    --element_count;
+    return Iterator(this, next);
+}
+
+template <class Type, class Index>
+void PooledList <Type, Index>::popBack()
+{
+    erase(Iterator(this, tail));
+}
+
+template <class Type, class Index>
+void PooledList <Type, Index>::popFront()
+{
+    erase(begin());
+}
+
+template <class Type, class Index>
+Type &PooledList <Type, Index>::front() const
+{
+    assert(head);
+
+    return head->value;
+}
+
+template <class Type, class Index>
+Type &PooledList <Type, Index>::back() const
+{
+    assert(tail);
+
+    return tail->value;
+}
+
+template <class Type, class Index>
+typename PooledList <Type, Index>::Iterator
+PooledList <Type, Index>::begin() const
+{
+    return Iterator(this, head);
+}
+
+template <class Type, class Index>
+typename PooledList <Type, Index>::Iterator
+PooledList <Type, Index>::end() const
+{
+    return Iterator(this, nullptr);
+}
+
+template <class Type, class Index>
+size_t PooledList <Type, Index>::size() const
+{
+    return element_count;
+}
+
+template <class Type, class Index>
+bool PooledList <Type, Index>::empty() const
+{
+    return element_count == 0;
+}
+
+template <class Type, class Index>
+void PooledList <Type, Index>::clear()
+{
+    while (head) {
+        Node * const next = nodes.get(head->next);
+        nodes.destroy(head);
+        head = next;
+    }
+
+    tail = nullptr;
+    element_count = 0;
+}
+
+template <class Type, class Index = void>
+class PooledQueue
+{
+public:
+    // --------------------------
+    // node of the queue, exposed for creating
+    // shared FreeLists
+    struct Node
+    {
+        template <class ...Args>
+        explicit Node(Args &&...args)
+        : value(std::forward<Args>(args)...)
+        {
+        }
+
+        Type value;
+        typename PooledLink <Node, Index>::type next{};
+    };
+
+    // --------------------------
+    // creates a queue with its own FreeList for
+    // "capacity" nodes
+    explicit PooledQueue(const size_t capacity);
+
+    // --------------------------
+    // creates a queue taking nodes from "shared_pool"
+    explicit PooledQueue(FreeList <Node> &shared_pool);
+
+    // --------------------------
+    // copy constructor is forbidden
+    PooledQueue(const PooledQueue &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for PooledQueue
+    PooledQueue &operator =(const PooledQueue &) = delete;
+
+    ~PooledQueue();
+
+    // ---------------------
+    // adds an element constructed from "args" to
+    // the end of the queue
+    template <class ...Args>
+    Type &emplace(Args &&...args);
+
+    void push(const Type &value);
+
+    // ---------------------
+    // removes the first element
+    void pop();
+
+    Type &front() const;
+
+    Type &back() const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    void clear();
+
+private:
+    PooledNodes <Node, Index> nodes;
+    Node *head;
+    Node *tail;
+    size_t element_count;
+};
+
+template <class Type, class Index>
+PooledQueue <Type, Index>::PooledQueue(const size_t capacity)
+: nodes(capacity),
+  head(nullptr),
+  tail(nullptr),
+  element_count(0)
+{
+}
+
+template <class Type, class Index>
+PooledQueue <Type, Index>::PooledQueue(FreeList <Node> &shared_pool)
+: nodes(shared_pool),
+  head(nullptr),
+  tail(nullptr),
+  element_count(0)
+{
+}
+
+template <class Type, class Index>
+PooledQueue <Type, Index>::~PooledQueue()
+{
+    clear();
+}
+
+template <class Type, class Index>
+    template <class ...Args>
+Type &PooledQueue <Type, Index>::emplace(Args &&...args)
+{
+    Node * const node = nodes.create(std::forward<Args>(args)...);
+
+    if (tail)
+        tail->next = nodes.link(node);
+    else
+        head = node;
+
+    tail = node;
+    ++element_count;
+    return node->value;
+}
+
+template <class Type, class Index>
+void PooledQueue <Type, Index>::push(const Type &value)
+{
+    emplace(value);
+}
+
+template <class Type, class Index>
+void PooledQueue <Type, Index>::pop()
+{
+    assert(head);
+
+    Node * const next = nodes.get(head->next);
+
+    nodes.destroy(head);
+    head = next;
+    if (!head)
+        tail = nullptr;
+    --element_count;
+}
+
+template <class Type, class Index>
+Type &PooledQueue <Type, Index>::front() const
+{
+    assert(head);
+
+    return head->value;
+}
+
+template <class Type, class Index>
+Type &PooledQueue <Type, Index>::back() const
+{
+    assert(tail);
+
+    return tail->value;
+}
+
+template <class Type, class Index>
+size_t PooledQueue <Type, Index>::size() const
+{
+    return element_count;
+}
+
+template <class Type, class Index>
+bool PooledQueue <Type, Index>::empty() const
+{
+    return element_count == 0;
+}
+
+template <class Type, class Index>
+void PooledQueue <Type, Index>::clear()
+{
+    while (head)
+        pop();
+}
+
+template <class Key,
+          class Value,
+          class Hash = std::hash <Key>,
+          class KeyEqual = std::equal_to <Key>,
+          class Index = void>
+class PooledHashMap
+{
+public:
+    // --------------------------
+    // node of the map, exposed for creating
+    // shared FreeLists
+    struct Node
+    {
+        template <class KeyArg, class ...Args>
+        explicit Node(KeyArg &&init_key, Args &&...args)
+        : key(std::forward<KeyArg>(init_key)),
+          value(std::forward<Args>(args)...)
+        {
+        }
+
+        const Key key;
+        Value value;
+        typename PooledLink <Node, Index>::type next{};
+    };
+
+    // --------------------------
+    // creates a map with its own FreeList for "capacity"
+    // nodes. The bucket count is "capacity" rounded up
+    // to a power of two.
+    explicit PooledHashMap(const size_t capacity);
+
+    // --------------------------
+    // creates a map taking nodes from "shared_pool"
+    // with "bucket_count" buckets
+    PooledHashMap(FreeList <Node> &shared_pool, const size_t bucket_count);
+
+    // --------------------------
+    // copy constructor is forbidden
+    PooledHashMap(const PooledHashMap &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for PooledHashMap
+    PooledHashMap &operator =(const PooledHashMap &) = delete;
+
+    ~PooledHashMap();
+
+    // ---------------------
+    // inserts a value constructed from "args" if there is no
+    // "key" in the map yet. Returns the value stored for "key"
+    // and whether it was inserted.
+    template <class ...Args>
+    std::pair <Value *, bool> emplace(const Key &key, Args &&...args);
+
+    std::pair <Value *, bool> insert(const Key &key, const Value &value);
+
+    // ---------------------
+    // returns the value stored for "key" or nullptr
+    Value *find(const Key &key) const;
+
+    // ---------------------
+    // removes "key" from the map. Returns false if
+    // there was no such key.
+    bool erase(const Key &key);
+
+    // ---------------------
+    // calls "fn(key, value)" for every element
+    template <class Function>
+    void forEach(Function fn) const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    void clear();
+
+private:
+    using link_type = typename PooledNodes <Node, Index>::link_type;
+
+    PooledNodes <Node, Index> nodes;
+    std::vector <link_type> buckets;
+    Hash hasher;
+    KeyEqual key_equal;
+    size_t element_count;
+
+    link_type &bucketFor(const Key &key);
+
+    const link_type &bucketFor(const Key &key) const;
+
+    static size_t roundUpToPowerOfTwo(const size_t value);
+};
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+PooledHashMap <Key, Value, Hash, KeyEqual, Index>::PooledHashMap(
+        const size_t capacity)
+: nodes(capacity),
+  buckets(roundUpToPowerOfTwo(capacity)),
+  element_count(0)
+{
+}
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+PooledHashMap <Key, Value, Hash, KeyEqual, Index>::PooledHashMap(
+        FreeList <Node> &shared_pool,
+        const size_t bucket_count)
+: nodes(shared_pool),
+  buckets(roundUpToPowerOfTwo(bucket_count)),
+  element_count(0)
+{
+}
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+PooledHashMap <Key, Value, Hash, KeyEqual, Index>::~PooledHashMap()
+{
+    clear();
+}
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+    template <class ...Args>
+std::pair <Value *, bool>
+PooledHashMap <Key, Value, Hash, KeyEqual, Index>::emplace(
+        const Key &key, Args &&...args)
+{
+    if (Value * const found = find(key))
+        return {found, false};
+
+    link_type &bucket = bucketFor(key);
+    Node * const node = nodes.create(key, std::forward<Args>(args)...);
+
+    node->next = bucket;
+    bucket = nodes.link(node);
+    ++element_count;
+    return {&node->value, true};
+}
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+std::pair <Value *, bool>
+PooledHashMap <Key, Value, Hash, KeyEqual, Index>::insert(
+        const Key &key, const Value &value)
+{
+    return emplace(key, value);
+}
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+Value *PooledHashMap <Key, Value, Hash, KeyEqual, Index>::find(
+        const Key &key) const
+{
+    for (Node *node = nodes.get(bucketFor(key)); node;
+         node = nodes.get(node->next)) {
+        if (key_equal(node->key, key))
+            return &node->value;
+    }
+
+    return nullptr;
+}
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+bool PooledHashMap <Key, Value, Hash, KeyEqual, Index>::erase(
+        const Key &key)
+{
+    link_type *link = &bucketFor(key);
+
+    for (Node *node = nodes.get(*link); node; node = nodes.get(*link)) {
+        if (key_equal(node->key, key)) {
+            *link = node->next;
+            nodes.destroy(node);
+            --element_count;
+            return true;
+        }
+
+        link = &node->next;
+    }
+
+    return false;
+}
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+    template <class Function>
+void PooledHashMap <Key, Value, Hash, KeyEqual, Index>::forEach(
+        Function fn) const
+{
+    for (const link_type &bucket : buckets) {
+        for (Node *node = nodes.get(bucket); node;
+             node = nodes.get(node->next))
+            fn(node->key, node->value);
+    }
+}
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+size_t PooledHashMap <Key, Value, Hash, KeyEqual, Index>::size() const
+{
+    return element_count;
+}
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+bool PooledHashMap <Key, Value, Hash, KeyEqual, Index>::empty() const
+{
+    return element_count == 0;
+}
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+void PooledHashMap <Key, Value, Hash, KeyEqual, Index>::clear()
+{
+    for (link_type &bucket : buckets) {
+        Node *node = nodes.get(bucket);
+
+        while (node) {
+            Node * const next = nodes.get(node->next);
+            nodes.destroy(node);
+            node = next;
+        }
+
+        bucket = link_type{};
+    }
+
+    element_count = 0;
+}
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+typename PooledHashMap <Key, Value, Hash, KeyEqual, Index>::link_type &
+PooledHashMap <Key, Value, Hash, KeyEqual, Index>::bucketFor(const Key &key)
+{
+    return buckets[hasher(key) & (buckets.size() - 1)];
+}
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+const typename PooledHashMap <Key, Value, Hash, KeyEqual, Index>::link_type &
+PooledHashMap <Key, Value, Hash, KeyEqual, Index>::bucketFor(
+        const Key &key) const
+{
+    return buckets[hasher(key) & (buckets.size() - 1)];
+}
+
+template <class Key, class Value, class Hash, class KeyEqual, class Index>
+size_t PooledHashMap <Key, Value, Hash, KeyEqual, Index>::roundUpToPowerOfTwo(
+        const size_t value)
+{
+    size_t result = 1;
+
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+#endif // POOLED_CONTAINERS_HPP
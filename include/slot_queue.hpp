@@ -0,0 +1,297 @@
+// Copyright 2018 Katolikian Tihran
+
+// SlotQueue is a bounded lock-free multi-producer
+// multi-consumer ring (after Dmitry Vyukov's queue) which
+// carries indices of pool segments instead of pointers.
+// Together with a pool (FreeList, BitmapFreeList or
+// IndexFreeList) it hands pooled objects between threads
+// without copying them and without touching the heap:
+// "tryConstructAndPush" allocates and enqueues, and
+// "tryPopAndDestruct" dequeues, consumes and frees.
+//
+// The pool is used from several threads, so it should be
+// compiled with "FL_THREAD_SAFETY".
+
+#ifndef SLOT_QUEUE_HPP
+#define SLOT_QUEUE_HPP
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+template <class Index = uint32_t>
+class SlotQueue
+{
+    static_assert(std::is_unsigned <Index>::value,
+                  "Index must be an unsigned integer type");
+
+public:
+    // --------------------------
+    // creates a queue for at least "init_capacity" indices
+    // (the capacity is rounded up to a power of two)
+    explicit SlotQueue(const size_t init_capacity);
+
+    // --------------------------
+    // copy constructor is forbidden
+    SlotQueue(const SlotQueue &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for SlotQueue
+    SlotQueue &operator =(const SlotQueue &) = delete;
+
+    ~SlotQueue();
+
+    // ---------------------
+    // adds "index" to the queue. Returns false if the
+    // queue is full.
+    bool tryPush(const Index index);
+
+    // ---------------------
+    // takes the oldest index from the queue. Returns false
+    // if the queue is empty.
+    bool tryPop(Index &index);
+
+    // ---------------------
+    // creates an object on a free place of "pool", passes
+    // "args" in its constructor and enqueues its index. If
+    // the pool has no segment for the caller (it is exhausted,
+    // or only reserved segments are left) false is returned;
+    // if the queue is full the object is destroyed and false
+    // is returned. Pools with "tryGetFreePlace" are asked
+    // without exceptions, so a refused push does not allocate.
+    // Exceptions of the constructor are passed to the caller.
+    template <class Pool, class ...Args>
+    bool tryConstructAndPush(Pool &pool, Args &&...args);
+
+    // ---------------------
+    // dequeues an index, calls "fn" with the object of "pool"
+    // it refers to, then destroys the object and marks it as
+    // free. Returns false if the queue is empty.
+    template <class Pool, class Function>
+    bool tryPopAndDestruct(Pool &pool, Function fn);
+
+    size_t getCapacity() const;
+
+private:
+    static constexpr size_t cache_line_size = 64;
+
+    struct Cell
+    {
+        std::atomic <size_t> sequence;
+        Index index;
+    };
+
+    // capacity - 1, capacity is a power of two
+    const size_t mask;
+    Cell * const cells;
+
+    // producers and consumers work on different cache lines
+    alignas(cache_line_size) std::atomic <size_t> enqueue_position;
+    alignas(cache_line_size) std::atomic <size_t> dequeue_position;
+
+    static size_t roundUpToPowerOfTwo(const size_t value);
+
+    // ---------------------
+    // returns a free place of "pool" or nullptr
+    template <class Pool>
+    static auto tryGetFreePlace(Pool &pool) -> decltype(pool.getFreePlace());
+
+    template <class Pool, class = void>
+    struct HasTryGetFreePlace : std::false_type
+    {
+    };
+
+    template <class Pool>
+    struct HasTryGetFreePlace <Pool, std::void_t <
+            decltype(std::declval <Pool &>().tryGetFreePlace())>>
+    : std::true_type
+    {
+    };
+};
+
+template <class Index>
+SlotQueue <Index>::SlotQueue(const size_t init_capacity)
+: mask(roundUpToPowerOfTwo(init_capacity) - 1),
+  cells(new Cell[mask + 1]),
+  enqueue_position(0),
+  dequeue_position(0)
+{
+    for (size_t i = 0; i <= mask; ++i)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template <class Index>
+SlotQueue <Index>::~SlotQueue()
+{
+    delete [] cells;
+}
+
+template <class Index>
+bool SlotQueue <Index>::tryPush(const Index index)
+{
+    size_t position = enqueue_position.load(std::memory_order_relaxed);
+
+    for (;;) {
+        Cell &cell = cells[position & mask];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const std::ptrdiff_t difference =
+                static_cast <std::ptrdiff_t>(sequence) -
+                static_cast <std::ptrdiff_t>(position);
+
+        if (difference == 0) {
+            // ----------------------
+            // the cell is free: try to own it
+            if (enqueue_position.compare_exchange_weak(
+                    position, position + 1, std::memory_order_relaxed)) {
+                cell.index = index;
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0) {
+            // ----------------------
+            // the cell still holds an index from the previous
+            // lap: the queue is full
+            return false;
+        }
+        else {
+            position = enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <class Index>
+bool SlotQueue <Index>::tryPop(Index &index)
+{
+    size_t position = dequeue_position.load(std::memory_order_relaxed);
+
+    for (;;) {
+        Cell &cell = cells[position & mask];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const std::ptrdiff_t difference =
+                static_cast <std::ptrdiff_t>(sequence) -
+                static_cast <std::ptrdiff_t>(position + 1);
+
+        if (difference == 0) {
+            // ----------------------
+            // the cell is filled: try to own it
+            if (dequeue_position.compare_exchange_weak(
+                    position, position + 1, std::memory_order_relaxed)) {
+                index = cell.index;
+                cell.sequence.store(position + mask + 1,
+                                    std::memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0) {
+            // ----------------------
+            // nothing was pushed to the cell yet:
+            // the queue is empty
+            return false;
+        }
+        else {
+            position = dequeue_position.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <class Index>
+    template <class Pool, class ...Args>
+bool SlotQueue <Index>::tryConstructAndPush(Pool &pool, Args &&...args)
+{
+    using Type = typename std::remove_pointer <
+            decltype(pool.getFreePlace())>::type;
+
+    Type * const place = tryGetFreePlace(pool);
+
+    if (place == nullptr)
+        return false;
+
+    Type *ptr;
+
+    try {
+        ptr = new (place) Type(std::forward<Args>(args)...);
+    }
+    catch (...) {
+        pool.markAsFree(place);
+        throw;
+    }
+
+    const size_t index = pool.getIndex(ptr);
+
+    assert(index <= std::numeric_limits <Index>::max());
+
+    if (tryPush(static_cast <Index>(index)))
+        return true;
+
+    pool.destructAndMarkAsFree(ptr);
+    return false;
+}
+
+template <class Index>
+    template <class Pool, class Function>
+bool SlotQueue <Index>::tryPopAndDestruct(Pool &pool, Function fn)
+{
+    Index index;
+
+    if (!tryPop(index))
+        return false;
+
+    auto * const ptr = pool.at(index);
+
+    try {
+        fn(*ptr);
+    }
+    catch (...) {
+        pool.destructAndMarkAsFree(ptr);
+        throw;
+    }
+
+    pool.destructAndMarkAsFree(ptr);
+    return true;
+}
+
+template <class Index>
+size_t SlotQueue <Index>::getCapacity() const
+{
+    return mask + 1;
+}
+
+template <class Index>
+    template <class Pool>
+auto SlotQueue <Index>::tryGetFreePlace(Pool &pool)
+        -> decltype(pool.getFreePlace())
+{
+    if constexpr (HasTryGetFreePlace <Pool>::value) {
+        return pool.tryGetFreePlace();
+    }
+    else {
+        // ----------------------
+        // pools without "tryGetFreePlace" report
+        // exhaustion with an exception
+        try {
+            return pool.getFreePlace();
+        }
+        catch (std::runtime_error &) {
+            return nullptr;
+        }
+    }
+}
+
+template <class Index>
+size_t SlotQueue <Index>::roundUpToPowerOfTwo(const size_t value)
+{
+    size_t result = 1;
+
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+#endif // SLOT_QUEUE_HPP
@@ -0,0 +1,262 @@
+// Copyright 2018 Katolikian Tihran
+
+// VersionedFreeList is a FreeList whose segments carry a version
+// for seqlock-style optimistic reads. The version of a segment
+// keeps two counters: the generation, increased every time the
+// segment is freed, and the sequence, odd while a writer is
+// updating the object. A reader copies the object without any
+// lock and then checks that the version did not change, so it
+// sees either a consistent copy or learns that the object was
+// being written, or was freed and reused underneath it.
+//
+// Allocations and frees may happen on several threads only if
+// the library is compiled with "FL_THREAD_SAFETY"; reads never
+// take the lock.
+
+#ifndef VERSIONED_FREELIST_HPP
+#define VERSIONED_FREELIST_HPP
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "freelist.hpp"
+
+template <class Type>
+class VersionedFreeList
+{
+public:
+    // --------------------------
+    // refers to one life of an object: stays valid until
+    // the object is freed
+    struct Handle
+    {
+        uint32_t index;
+        uint32_t generation;
+    };
+
+    // --------------------------
+    // creates a VersionedFreeList which can handle
+    // "init_list_size" objects of type "Type"
+    explicit VersionedFreeList(const size_t init_list_size);
+
+    // --------------------------
+    // copy constructor is forbidden
+    VersionedFreeList(const VersionedFreeList &) = delete;
+
+    // --------------------------
+    // assigment is forbidden for VersionedFreeList
+    VersionedFreeList &operator =(const VersionedFreeList &) = delete;
+
+    // ---------------------
+    // creates an object of type "Type" on a free place and
+    // passes "args" in its constructor
+    template <class ...Args>
+    Type *constructOnFreePlace(Args &&...args);
+
+    // ---------------------
+    // invalidates all handles to the object, calls its
+    // destructor and marks it as free
+    void destructAndMarkAsFree(Type * const ptr);
+
+    // ---------------------
+    // returns handle to the current life of the object
+    Handle getHandle(const Type * const ptr) const;
+
+    // ---------------------
+    // returns the object "handle" refers to. It may be freed
+    // or reused already, so it should be read with "tryRead"
+    // unless the caller owns it.
+    Type *at(const Handle &handle) const;
+
+    // ---------------------
+    // a writer wraps every update of the object in these calls.
+    // Writers of one object should not run concurrently.
+    void beginWrite(Type * const ptr);
+
+    void endWrite(Type * const ptr);
+
+    // ---------------------
+    // calls "fn(*ptr)" between "beginWrite" and "endWrite"
+    template <class Function>
+    void write(Type * const ptr, Function fn);
+
+    // ---------------------
+    // copies the object "handle" refers to into "out". Retries
+    // while the object is being written. Returns false if the
+    // object was freed (and maybe reused) since the handle
+    // was taken.
+    bool tryRead(const Handle &handle, Type &out) const;
+
+    // ---------------------
+    // return size in bytes allocated for
+    // data
+    size_t getPhysicalSize() const;
+
+private:
+    static constexpr unsigned generation_shift = 32;
+    static constexpr uint64_t sequence_mask = (uint64_t(1) << 32) - 1;
+
+    FreeList <Type> list;
+    // generation << 32 | sequence for every segment
+    std::unique_ptr <std::atomic <uint64_t>[]> versions;
+};
+
+template <class Type>
+VersionedFreeList <Type>::VersionedFreeList(const size_t init_list_size)
+: list(init_list_size),
+  versions(new std::atomic <uint64_t>[init_list_size])
+{
+    for (size_t i = 0; i < init_list_size; ++i)
+        versions[i].store(0, std::memory_order_relaxed);
+}
+
+template <class Type>
+    template <class ...Args>
+Type *VersionedFreeList <Type>::constructOnFreePlace(Args &&...args)
+{
+    Type * const place = list.getFreePlace();
+
+    try {
+        return new (place) Type(std::forward<Args>(args)...);
+    }
+    catch (...) {
+        list.markAsFree(place);
+        throw;
+    }
+}
+
+template <class Type>
+void VersionedFreeList <Type>::destructAndMarkAsFree(Type * const ptr)
+{
+    std::atomic <uint64_t> &version = versions[list.getIndex(ptr)];
+    const uint64_t current = version.load(std::memory_order_relaxed);
+
+    assert((current & 1) == 0);
+
+    // ----------------------
+    // the destructor runs with an odd sequence, as a
+    // write does, so readers do not accept a half
+    // destroyed object
+    version.store(current + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    ptr->~Type();
+
+    // ----------------------
+    // readers holding the old generation fail from now on.
+    // The new version must be visible before the next owner
+    // of the segment constructs an object on it.
+    version.store((current & ~sequence_mask) +
+                  (uint64_t(1) << generation_shift) +
+                  ((current + 2) & sequence_mask),
+                  std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    list.markAsFree(ptr);
+}
+
+template <class Type>
+typename VersionedFreeList <Type>::Handle
+VersionedFreeList <Type>::getHandle(const Type * const ptr) const
+{
+    const size_t index = list.getIndex(ptr);
+    const uint64_t version = versions[index].load(std::memory_order_acquire);
+
+    return {static_cast <uint32_t>(index),
+            static_cast <uint32_t>(version >> generation_shift)};
+}
+
+template <class Type>
+Type *VersionedFreeList <Type>::at(const Handle &handle) const
+{
+    return list.at(handle.index);
+}
+
+template <class Type>
+void VersionedFreeList <Type>::beginWrite(Type * const ptr)
+{
+    std::atomic <uint64_t> &version = versions[list.getIndex(ptr)];
+
+    assert((version.load(std::memory_order_relaxed) & 1) == 0);
+
+    version.fetch_add(1, std::memory_order_relaxed);
+    // ----------------------
+    // the odd sequence must be visible before
+    // the object changes
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+template <class Type>
+void VersionedFreeList <Type>::endWrite(Type * const ptr)
+{
+    std::atomic <uint64_t> &version = versions[list.getIndex(ptr)];
+    const uint64_t current = version.load(std::memory_order_relaxed);
+
+    assert((current & 1) != 0);
+
+    // ----------------------
+    // there is only one writer, so a plain store is enough.
+    // The sequence wraps around without touching
+    // the generation.
+    version.store((current & ~sequence_mask) | ((current + 1) & sequence_mask),
+                  std::memory_order_release);
+}
+
+template <class Type>
+    template <class Function>
+void VersionedFreeList <Type>::write(Type * const ptr, Function fn)
+{
+    beginWrite(ptr);
+
+    try {
+        fn(*ptr);
+    }
+    catch (...) {
+        endWrite(ptr);
+        throw;
+    }
+
+    endWrite(ptr);
+}
+
+template <class Type>
+bool VersionedFreeList <Type>::tryRead(const Handle &handle, Type &out) const
+{
+    static_assert(std::is_trivially_copyable <Type>::value,
+                  "optimistic reads require a trivially copyable Type");
+
+    const std::atomic <uint64_t> &version = versions[handle.index];
+    const Type * const ptr = list.at(handle.index);
+
+    for (;;) {
+        const uint64_t before = version.load(std::memory_order_acquire);
+
+        if (before >> generation_shift != handle.generation)
+            return false;
+        if ((before & 1) != 0)
+            continue;
+
+        std::memcpy(static_cast <void *>(&out), ptr, sizeof(Type));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        const uint64_t after = version.load(std::memory_order_relaxed);
+
+        if (after == before)
+            return true;
+        if (after >> generation_shift != handle.generation)
+            return false;
+    }
+}
+
+template <class Type>
+size_t VersionedFreeList <Type>::getPhysicalSize() const
+{
+    return list.getPhysicalSize();
+}
+
+#endif // VERSIONED_FREELIST_HPP
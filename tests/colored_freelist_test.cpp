@@ -0,0 +1,231 @@
+// Copyright 2018 Katolikian Tihran
+
+// Gives threads of a ColoredFreeList their own regions: every
+// thread allocates from the region of its color until it is
+// exhausted and then from the others, objects may be freed by
+// any thread, and threads which do not fit in the color table
+// still get a valid color. Built with and without
+// "FL_THREAD_SAFETY", which choose different region locks.
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "../include/colored_freelist.hpp"
+
+namespace
+{
+
+std::atomic <int> alive(0);
+
+struct Item
+{
+    int value;
+
+    explicit Item(const int init_value)
+    : value(init_value)
+    {
+        alive.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~Item()
+    {
+        alive.fetch_sub(1, std::memory_order_relaxed);
+    }
+};
+
+void check(const bool condition, const char * const what)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << what << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// ----------------------
+// runs "fn" in a new thread and waits for it, so threads
+// are new to a list in a known order
+template <class Function>
+void runThread(Function fn)
+{
+    std::thread(fn).join();
+}
+
+void testDistinctRegions()
+{
+    constexpr size_t region_count = 4;
+
+    ColoredFreeList <Item> list(64, region_count);
+    std::set <size_t> colors;
+
+    for (size_t t = 0; t < region_count; ++t) {
+        runThread([&] {
+            Item * const item = list.constructOnFreePlace(int(t));
+            const size_t color = list.getThreadColor();
+
+            check(color == t, "threads get colors in order");
+            check(list.getRegion(item) == color,
+                  "a thread allocates from its own region");
+            check(list.getThreadColor() == color, "a color is kept");
+            colors.insert(color);
+            list.destructAndMarkAsFree(item);
+        });
+    }
+
+    check(colors.size() == region_count, "threads get distinct regions");
+    check(alive.load() == 0, "every item is destroyed");
+}
+
+void testFallback()
+{
+    // ----------------------
+    // two regions of two segments
+    ColoredFreeList <Item> list(4, 2);
+    const size_t color = list.getThreadColor();
+    std::vector <Item *> items;
+
+    for (int i = 0; i < 4; ++i)
+        items.push_back(list.constructOnFreePlace(i));
+
+    check(list.getRegion(items[0]) == color &&
+          list.getRegion(items[1]) == color,
+          "the own region is used first");
+    check(list.getRegion(items[2]) != color &&
+          list.getRegion(items[3]) != color,
+          "another region is used when the own one is exhausted");
+
+    bool thrown = false;
+
+    try {
+        list.getFreePlace();
+    }
+    catch (std::runtime_error &) {
+        thrown = true;
+    }
+    check(thrown, "getFreePlace throws when every region is exhausted");
+
+    // ----------------------
+    // a freed segment of the own region is preferred again
+    list.destructAndMarkAsFree(items[1]);
+    items[1] = list.constructOnFreePlace(1);
+    check(list.getRegion(items[1]) == color, "the own region is refilled");
+
+    for (Item * const item : items)
+        list.destructAndMarkAsFree(item);
+    check(alive.load() == 0, "every item is destroyed");
+}
+
+void testCrossThreadFree()
+{
+    constexpr int threads_count = 4;
+    constexpr int per_thread = 2000;
+    constexpr int batch = 16;
+
+    // ----------------------
+    // a region holds the batch of its thread, the one in
+    // "handoff" and the ones the other threads are freeing
+    ColoredFreeList <Item> list(threads_count * (threads_count + 1) * batch,
+                                threads_count);
+    std::mutex handoff_mutex;
+    std::vector <Item *> handoff;
+    std::atomic <int> freed(0);
+    std::atomic <bool> own_region(true);
+    std::vector <std::thread> threads;
+
+    // ----------------------
+    // every thread frees items allocated by the others
+    for (int t = 0; t < threads_count; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < per_thread; i += batch) {
+                std::vector <Item *> mine;
+
+                for (int j = 0; j < batch; ++j) {
+                    Item * const item = list.constructOnFreePlace(j);
+
+                    if (list.getRegion(item) != list.getThreadColor())
+                        own_region.store(false);
+                    mine.push_back(item);
+                }
+
+                std::vector <Item *> theirs;
+
+                {
+                    std::lock_guard <std::mutex> lg(handoff_mutex);
+
+                    theirs.swap(handoff);
+                    handoff = mine;
+                }
+
+                for (Item * const item : theirs) {
+                    list.destructAndMarkAsFree(item);
+                    freed.fetch_add(1);
+                }
+            }
+        });
+    }
+
+    for (auto &thread : threads)
+        thread.join();
+
+    for (Item * const item : handoff) {
+        list.destructAndMarkAsFree(item);
+        freed.fetch_add(1);
+    }
+
+    check(own_region.load(), "threads allocate from their own regions");
+    check(freed.load() == threads_count * per_thread, "every item is freed");
+    check(alive.load() == 0, "every item is destroyed");
+}
+
+void testFullColorTable()
+{
+    constexpr size_t region_count = 3;
+    // ----------------------
+    // more threads than entries of the smallest color table
+    constexpr size_t threads_count = 100;
+    constexpr size_t table_size = 64;
+
+    ColoredFreeList <Item> list(region_count * 4, region_count);
+    std::vector <size_t> counts(region_count, 0);
+
+    for (size_t t = 0; t < threads_count; ++t) {
+        runThread([&] {
+            const size_t color = list.getThreadColor();
+
+            check(color < region_count, "a color names a region");
+            check(t >= table_size || color == t % region_count,
+                  "threads in the table share regions round robin");
+            check(list.getThreadColor() == color, "a color is kept");
+
+            Item * const item = list.constructOnFreePlace(int(t));
+
+            check(list.getRegion(item) == color,
+                  "a thread out of the table uses the region of its color");
+            list.destructAndMarkAsFree(item);
+            ++counts[color];
+        });
+    }
+
+    for (const size_t count : counts)
+        check(count != 0, "every region is used");
+    check(alive.load() == 0, "every item is destroyed");
+}
+
+} // namespace
+
+int main()
+{
+    testDistinctRegions();
+    testFallback();
+    testCrossThreadFree();
+    testFullColorTable();
+
+    std::cout << "colored_freelist_test passed\n";
+
+    return EXIT_SUCCESS;
+}
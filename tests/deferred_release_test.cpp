@@ -0,0 +1,156 @@
+// Copyright 2018 Katolikian Tihran
+
+// Defers destruction of pooled objects: a full queue destroys
+// the object right away, "drain" destroys at most the requested
+// number of objects across batches, and a background thread
+// drains objects deferred by several threads until it is
+// stopped.
+
+#define FL_THREAD_SAFETY
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../include/deferred_release.hpp"
+
+namespace
+{
+
+std::atomic <int> alive(0);
+
+struct Item
+{
+    int value;
+
+    explicit Item(const int init_value)
+    : value(init_value)
+    {
+        alive.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~Item()
+    {
+        alive.fetch_sub(1, std::memory_order_relaxed);
+    }
+};
+
+void check(const bool condition, const char * const what)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << what << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+void testOverflow()
+{
+    FreeList <Item> pool(8);
+    DeferredRelease <Item> deferred(pool, 4);
+
+    for (int i = 0; i < 6; ++i)
+        deferred.defer(pool.constructOnFreePlace(i));
+
+    check(alive.load() == 4, "a full queue destroys objects right away");
+    check(pool.getStats().live == 4, "destroyed objects are back in the pool");
+    check(deferred.drain() == 4, "queued objects are drained");
+    check(alive.load() == 0, "every item is destroyed");
+    check(pool.getStats().live == 0, "every item is back in the pool");
+}
+
+void testDrainLimit()
+{
+    constexpr int count = 100;
+
+    FreeList <Item> pool(count);
+    DeferredRelease <Item> deferred(pool, 128);
+
+    for (int i = 0; i < count; ++i)
+        deferred.defer(pool.constructOnFreePlace(i));
+
+    check(alive.load() == count, "deferred objects stay alive");
+    check(deferred.drain(10) == 10, "drain stops at the limit");
+    check(alive.load() == count - 10, "only drained objects are destroyed");
+
+    // ----------------------
+    // more than one batch
+    check(deferred.drain(70) == 70, "drain spans batches");
+    check(pool.getStats().live == count - 80,
+          "drained objects are back in the pool");
+    check(deferred.drain() == count - 80, "the rest is drained");
+    check(deferred.drain() == 0, "an empty queue drains nothing");
+    check(alive.load() == 0, "every item is destroyed");
+}
+
+void testBackground()
+{
+    constexpr int threads_count = 3;
+    constexpr int per_thread = 5000;
+
+    FreeList <Item> pool(1024);
+    std::vector <std::thread> threads;
+
+    {
+        DeferredRelease <Item> deferred(pool, 256);
+
+        deferred.startBackground(std::chrono::milliseconds(1));
+
+        for (int t = 0; t < threads_count; ++t) {
+            threads.emplace_back([&] {
+                for (int i = 0; i < per_thread; ) {
+                    if (Item * const place = pool.tryGetFreePlace()) {
+                        deferred.defer(new (place) Item(i));
+                        ++i;
+                    }
+                    else {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+
+        for (auto &thread : threads)
+            thread.join();
+
+        // ----------------------
+        // the background thread empties the queue on its own
+        const auto deadline = std::chrono::steady_clock::now() +
+                              std::chrono::seconds(10);
+
+        while (alive.load() != 0 &&
+               std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        check(alive.load() == 0, "the background thread drains the queue");
+
+        deferred.stopBackground();
+
+        // ----------------------
+        // nothing drains the queue after the thread is stopped
+        deferred.defer(pool.constructOnFreePlace(0));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        check(alive.load() == 1, "a stopped thread does not drain");
+
+        // ----------------------
+        // the destructor drains the rest
+    }
+
+    check(alive.load() == 0, "every item is destroyed");
+    check(pool.getStats().live == 0, "every item is back in the pool");
+}
+
+} // namespace
+
+int main()
+{
+    testOverflow();
+    testDrainLimit();
+    testBackground();
+
+    std::cout << "deferred_release_test passed\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+// Copyright 2018 Katolikian Tihran
+
+// Replays in one thread the interleaving where the global epoch
+// moves ahead of the epoch pinned by the retiring thread. A node
+// retired then may still be read by a thread which pinned the
+// newer epoch, so it must survive one more advance.
+
+#include <cstdlib>
+#include <iostream>
+
+#include "../include/epoch_reclaimer.hpp"
+
+namespace
+{
+
+int destroyed = 0;
+
+struct Node
+{
+    int value;
+
+    explicit Node(const int init_value)
+    : value(init_value)
+    {
+    }
+
+    ~Node()
+    {
+        ++destroyed;
+    }
+};
+
+void check(const bool condition, const char * const what)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << what << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    FreeList <Node> pool(16);
+    EpochReclaimer <Node> reclaimer(pool, 2, 1000);
+    EpochReclaimer <Node>::Participant &retiring = reclaimer.registerThread();
+    EpochReclaimer <Node>::Participant &reader = reclaimer.registerThread();
+
+    Node * const node = pool.constructOnFreePlace(42);
+
+    // ----------------------
+    // the retiring thread pins epoch 0, then the global
+    // epoch moves to 1 and the reader pins it and sees "node"
+    retiring.enter();
+    retiring.collect();
+    check(reclaimer.getEpoch() == 1, "the epoch advances to 1");
+
+    reader.enter();
+
+    // ----------------------
+    // "node" is unlinked and retired by the thread still
+    // pinned at epoch 0
+    retiring.retire(node);
+    retiring.exit();
+
+    // ----------------------
+    // the reader is pinned at the current epoch,
+    // so it may advance once more
+    reader.collect();
+    check(reclaimer.getEpoch() == 2, "the epoch advances to 2");
+
+    retiring.enter();
+    check(destroyed == 0, "a node seen by a pinned reader is not released");
+    check(node->value == 42, "a node seen by a pinned reader is intact");
+    retiring.exit();
+
+    // ----------------------
+    // after the reader leaves, two more advances release it
+    reader.exit();
+
+    for (int i = 0; i < 2; ++i) {
+        retiring.enter();
+        retiring.collect();
+        retiring.exit();
+    }
+
+    check(destroyed == 1, "the node is released after the reader left");
+    check(pool.getStats().live == 0, "the node is back in the pool");
+
+    reclaimer.unregisterThread(reader);
+    reclaimer.unregisterThread(retiring);
+
+    std::cout << "epoch_reclaimer_test passed\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+// Copyright 2018 Katolikian Tihran
+
+// Runs trees of children and continuations on several workers,
+// then exhausts the job records of a worker: a child which could
+// not be created must not keep its parent unfinished, otherwise
+// "wait" never returns. Idle workers must sleep instead of
+// spinning, and wake up for new jobs.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#include "../include/job_system.hpp"
+
+namespace
+{
+
+void check(const bool condition, const char * const what)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << what << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// ----------------------
+// a hang is reported as a failure instead of stalling "make test"
+void startWatchdog()
+{
+    std::thread([] {
+        std::this_thread::sleep_for(std::chrono::seconds(30));
+        std::cerr << "FAILED: timed out\n";
+        std::_Exit(EXIT_FAILURE);
+    }).detach();
+}
+
+void testChildrenAndContinuations()
+{
+    constexpr int rounds = 200;
+    constexpr int children = 32;
+
+    JobSystem js(4, 128);
+    std::atomic <int> done_children(0);
+    std::atomic <int> continuations(0);
+    std::atomic <bool> ordered(true);
+
+    for (int round = 0; round < rounds; ++round) {
+        std::atomic <int> round_children(0);
+        JobSystem::Job *root = nullptr;
+
+        root = js.create([&] {
+            for (int i = 0; i < children; ++i) {
+                js.run(js.createChild(root, [&] {
+                    round_children.fetch_add(1);
+                    done_children.fetch_add(1);
+                }));
+            }
+        });
+
+        // ----------------------
+        // "after" runs only when "first" and its child are
+        // done, and "root" waits for it as well
+        std::atomic <int> first_done(0);
+        JobSystem::Job *first = nullptr;
+
+        first = js.createChild(root, [&] {
+            js.run(js.createChild(first, [&] {
+                first_done.fetch_add(1);
+            }));
+            first_done.fetch_add(1);
+        });
+        JobSystem::Job * const after = js.createContinuation(first, [&] {
+            if (first_done.load() != 2)
+                ordered.store(false);
+            continuations.fetch_add(1);
+        });
+        (void) after;
+
+        js.run(first);
+        js.run(root);
+        js.wait(root);
+
+        check(round_children.load() == children,
+              "all children are done when wait returns");
+    }
+
+    check(done_children.load() == rounds * children, "every child ran");
+    check(continuations.load() == rounds, "every continuation ran");
+    check(ordered.load(), "continuations run after their predecessor");
+}
+
+void testExhaustedPool()
+{
+    JobSystem js(1, 2);
+    int ran = 0;
+
+    JobSystem::Job * const root = js.create([&] { ++ran; });
+    JobSystem::Job * const child = js.createChild(root, [&] { ++ran; });
+
+    bool thrown = false;
+
+    try {
+        js.createChild(root, [&] { ++ran; });
+    }
+    catch (std::runtime_error &) {
+        thrown = true;
+    }
+    check(thrown, "createChild throws when the pool is full");
+
+    thrown = false;
+    try {
+        js.createContinuation(child, [&] { ++ran; });
+    }
+    catch (std::runtime_error &) {
+        thrown = true;
+    }
+    check(thrown, "createContinuation throws when the pool is full");
+
+    js.run(child);
+    js.run(root);
+    js.wait(root);
+
+    check(ran == 2, "the jobs created before the failure ran");
+
+    // ----------------------
+    // the records are back in the pool
+    JobSystem::Job * const next = js.create([&] { ++ran; });
+
+    js.run(next);
+    js.wait(next);
+
+    check(ran == 3, "the pool is usable after the failure");
+}
+
+void testIdleWorkersSleep()
+{
+    JobSystem js(4, 64);
+
+    // ----------------------
+    // let the workers run out of spins, then measure the
+    // processor time the idle process takes
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    const std::clock_t start = std::clock();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    const double idle_ms = 1000.0 * double(std::clock() - start) /
+                           CLOCKS_PER_SEC;
+
+    check(idle_ms < 50.0, "idle workers sleep");
+
+    // ----------------------
+    // sleeping workers still get the jobs
+    std::atomic <int> ran(0);
+    JobSystem::Job *root = nullptr;
+
+    root = js.create([&] {
+        for (int i = 0; i < 32; ++i)
+            js.run(js.createChild(root, [&] { ran.fetch_add(1); }));
+    });
+
+    js.run(root);
+    js.wait(root);
+
+    check(ran.load() == 32, "jobs run after the workers slept");
+}
+
+} // namespace
+
+int main()
+{
+    startWatchdog();
+
+    testChildrenAndContinuations();
+    testExhaustedPool();
+    testIdleWorkersSleep();
+
+    std::cout << "job_system_test passed\n";
+
+    return EXIT_SUCCESS;
+}
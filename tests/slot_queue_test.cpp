@@ -0,0 +1,214 @@
+// Copyright 2018 Katolikian Tihran
+
+// Hands pooled objects from several producer threads to several
+// consumer threads through a SlotQueue. Every object must be
+// consumed exactly once and returned to the pool. A push refused
+// by an exhausted pool must not allocate.
+
+#define FL_THREAD_SAFETY
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "../include/bitmap_freelist.hpp"
+#include "../include/freelist.hpp"
+#include "../include/slot_queue.hpp"
+
+// ----------------------
+// counts heap allocations of the whole program
+std::atomic <size_t> allocations(0);
+
+void *operator new(const size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (void * const ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * const ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void * const ptr, const size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace
+{
+
+std::atomic <int> alive(0);
+
+struct Message
+{
+    int producer;
+    int sequence;
+
+    Message(const int init_producer, const int init_sequence)
+    : producer(init_producer),
+      sequence(init_sequence)
+    {
+        alive.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~Message()
+    {
+        alive.fetch_sub(1, std::memory_order_relaxed);
+    }
+};
+
+void check(const bool condition, const char * const what)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << what << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+void testSingleThread()
+{
+    FreeList <Message> pool(2);
+    SlotQueue <uint32_t> queue(4);
+
+    check(queue.getCapacity() == 4, "the capacity is a power of two");
+    check(queue.tryConstructAndPush(pool, 0, 0), "the first push succeeds");
+    check(queue.tryConstructAndPush(pool, 0, 1), "the second push succeeds");
+    check(!queue.tryConstructAndPush(pool, 0, 2),
+          "a push fails when the pool is exhausted");
+    check(alive.load() == 2, "a failed push constructs nothing");
+
+    int expected = 0;
+    const auto consume = [&](Message &message) {
+        check(message.sequence == expected++, "indices come out in order");
+    };
+
+    check(queue.tryPopAndDestruct(pool, consume), "the first pop succeeds");
+    check(queue.tryPopAndDestruct(pool, consume), "the second pop succeeds");
+    check(!queue.tryPopAndDestruct(pool, consume),
+          "a pop fails when the queue is empty");
+    check(alive.load() == 0, "popped objects are destroyed");
+    check(pool.getStats().live == 0, "popped objects are back in the pool");
+
+    // ----------------------
+    // a full queue refuses indices without losing them
+    SlotQueue <uint32_t> small(2);
+    uint32_t index;
+
+    check(small.tryPush(7) && small.tryPush(8), "the queue fills up");
+    check(!small.tryPush(9), "a push fails when the queue is full");
+    check(small.tryPop(index) && index == 7, "the oldest index is popped");
+    check(small.tryPush(9), "a popped cell can be reused");
+    check(small.tryPop(index) && index == 8, "indices keep their order");
+    check(small.tryPop(index) && index == 9, "the reused cell is read");
+}
+
+void testRefusedPush()
+{
+    FreeList <Message> pool(4);
+    SlotQueue <uint32_t> queue(8);
+
+    pool.setReserve(1);
+
+    for (int i = 0; i < 3; ++i)
+        check(queue.tryConstructAndPush(pool, 0, i), "a push succeeds");
+
+    // ----------------------
+    // only the reserved segment is left
+    const size_t before = allocations.load();
+
+    for (int i = 0; i < 1000; ++i)
+        check(!queue.tryConstructAndPush(pool, 0, i),
+              "a push fails when only reserved segments are left");
+
+    check(allocations.load() == before, "a refused push does not allocate");
+    check(pool.getTierStats(FreeListPriority::normal).refusals == 1000,
+          "refused pushes are counted by the pool");
+
+    while (queue.tryPopAndDestruct(pool, [](Message &) {}))
+        ;
+
+    // ----------------------
+    // pools without "tryGetFreePlace" are refused as well
+    BitmapFreeList <Message> bitmap(1);
+
+    check(queue.tryConstructAndPush(bitmap, 0, 0), "a bitmap push succeeds");
+    check(!queue.tryConstructAndPush(bitmap, 0, 1),
+          "a bitmap push fails when the pool is exhausted");
+    check(queue.tryPopAndDestruct(bitmap, [](Message &) {}),
+          "a bitmap pop succeeds");
+    check(alive.load() == 0, "every message is destroyed");
+}
+
+void testManyThreads()
+{
+    constexpr int producers = 3;
+    constexpr int consumers = 3;
+    constexpr int per_producer = 20000;
+
+    FreeList <Message> pool(64);
+    SlotQueue <uint32_t> queue(64);
+    std::vector <std::atomic <int>> seen(producers * per_producer);
+    std::atomic <int> consumed(0);
+    std::vector <std::thread> threads;
+
+    for (auto &count : seen)
+        count.store(0);
+
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            for (int i = 0; i < per_producer; ) {
+                if (queue.tryConstructAndPush(pool, p, i))
+                    ++i;
+                else
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&] {
+            const auto consume = [&](Message &message) {
+                seen[message.producer * per_producer + message.sequence]
+                        .fetch_add(1);
+                consumed.fetch_add(1);
+            };
+
+            while (consumed.load() < producers * per_producer) {
+                if (!queue.tryPopAndDestruct(pool, consume))
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    for (auto &thread : threads)
+        thread.join();
+
+    bool once = true;
+
+    for (auto &count : seen)
+        once = once && count.load() == 1;
+
+    check(once, "every message is consumed exactly once");
+    check(alive.load() == 0, "every message is destroyed");
+    check(pool.getStats().live == 0, "every message is back in the pool");
+}
+
+} // namespace
+
+int main()
+{
+    testSingleThread();
+    testRefusedPush();
+    testManyThreads();
+
+    std::cout << "slot_queue_test passed\n";
+
+    return EXIT_SUCCESS;
+}
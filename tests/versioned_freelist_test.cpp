@@ -0,0 +1,156 @@
+// Copyright 2018 Katolikian Tihran
+
+// Checks optimistic reads of a VersionedFreeList: a read sees a
+// written object, a handle stops working once its object is freed
+// and the segment reused, and readers racing with a writer which
+// updates, frees and reallocates one segment never accept a torn
+// or foreign copy.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../include/versioned_freelist.hpp"
+
+namespace
+{
+
+struct Record
+{
+    uint64_t life;
+    uint64_t first;
+    uint64_t second;
+};
+
+void check(const bool condition, const char * const what)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << what << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+void testSingleThread()
+{
+    VersionedFreeList <Record> list(1);
+    Record * const record = list.constructOnFreePlace(Record{0, 1, 1});
+    const VersionedFreeList <Record>::Handle handle = list.getHandle(record);
+    Record copy;
+
+    check(list.tryRead(handle, copy) && copy.first == 1,
+          "a read sees the constructed object");
+
+    list.write(record, [](Record &r) {
+        r.first = 2;
+        r.second = 2;
+    });
+    check(list.tryRead(handle, copy) && copy.first == 2 && copy.second == 2,
+          "a read sees the written object");
+
+    // ----------------------
+    // the only segment is freed and reused
+    list.destructAndMarkAsFree(record);
+    check(!list.tryRead(handle, copy), "a handle fails after free");
+
+    Record * const reused = list.constructOnFreePlace(Record{1, 3, 3});
+
+    check(reused == record, "the segment is reused");
+    check(!list.tryRead(handle, copy), "a stale handle fails after reuse");
+    check(list.tryRead(list.getHandle(reused), copy) && copy.life == 1,
+          "a new handle reads the new object");
+
+    list.destructAndMarkAsFree(reused);
+}
+
+void testReadersAndWriter()
+{
+    using Handle = VersionedFreeList <Record>::Handle;
+
+    constexpr uint64_t lives = 2000;
+    constexpr uint64_t writes_per_life = 20;
+    constexpr int readers = 3;
+
+    VersionedFreeList <Record> list(1);
+    // ----------------------
+    // the handle of the current life, generation in the low
+    // half and index in the high half
+    std::atomic <uint64_t> published(0);
+    std::atomic <bool> done(false);
+    std::atomic <bool> consistent(true);
+    std::atomic <uint64_t> successful_reads(0);
+    std::vector <std::thread> threads;
+
+    Record *record = list.constructOnFreePlace(Record{0, 0, 0});
+
+    for (int r = 0; r < readers; ++r) {
+        threads.emplace_back([&] {
+            Record copy;
+
+            while (!done.load(std::memory_order_acquire)) {
+                const uint64_t packed =
+                        published.load(std::memory_order_acquire);
+                const Handle handle{static_cast <uint32_t>(packed >> 32),
+                                    static_cast <uint32_t>(packed)};
+
+                if (!list.tryRead(handle, copy))
+                    continue;
+
+                // ----------------------
+                // every life starts a new generation of the only
+                // segment, and a writer keeps both fields equal
+                if (copy.life != handle.generation ||
+                    copy.first != copy.second)
+                    consistent.store(false);
+                successful_reads.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    // ----------------------
+    // readers get to run before the writer starts, and between
+    // lives, even on a single processor
+    while (successful_reads.load() == 0)
+        std::this_thread::yield();
+
+    for (uint64_t life = 0; life < lives; ++life) {
+        for (uint64_t i = 1; i <= writes_per_life; ++i) {
+            list.write(record, [i](Record &r) {
+                r.first = i;
+                r.second = i;
+            });
+        }
+
+        list.destructAndMarkAsFree(record);
+        record = list.constructOnFreePlace(Record{life + 1, 0, 0});
+
+        const Handle handle = list.getHandle(record);
+
+        published.store(uint64_t(handle.index) << 32 | handle.generation,
+                         std::memory_order_release);
+        std::this_thread::yield();
+    }
+
+    done.store(true, std::memory_order_release);
+
+    for (auto &thread : threads)
+        thread.join();
+
+    check(consistent.load(), "readers accept only consistent copies");
+
+    list.destructAndMarkAsFree(record);
+}
+
+} // namespace
+
+int main()
+{
+    testSingleThread();
+    testReadersAndWriter();
+
+    std::cout << "versioned_freelist_test passed\n";
+
+    return EXIT_SUCCESS;
+}